@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -22,34 +22,222 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
-struct {
+// The cache is hashed by (dev, blockno) into NBUCKET buckets,
+// each a list of buffers under its own lock, so lookups of
+// different blocks on different harts don't contend. A buffer
+// moves between buckets only when it is recycled; bcache.lock
+// lets just one bget() at a time do that, so an evictor can hold
+// two bucket locks without deadlock. brelse() moves a buffer to
+// the front of its bucket and stamps it, so the least recently
+// used buffer of the whole cache is the oldest of the buckets'
+// rearmost unused buffers.
+//
+// Buffers come in groups of BPERPAGE sharing one kalloc() page
+// of data. binit() sizes the cache to 1/BCACHEFRAC of free
+// memory (at least NBUF buffers); breclaim() gives groups back
+// when kalloc() runs dry, and bgrowidle() regrows the cache
+// from idle CPUs once memory is plentiful again. The bucket
+// locks are innermost: nothing else is acquired, and kalloc()
+// is never called, while one is held.
+#define NBUCKET 61
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
+#define BPERPAGE (PGSIZE / BSIZE)
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf head;   // circular list through prev/next
+};
+
+struct bgroup {
+  struct bgroup *next;
+  uchar *page;
+  struct buf buf[BPERPAGE];
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  struct spinlock lock;    // serializes recycling, growing, shrinking
+  struct bucket bucket[NBUCKET];
+  uint64 stamp;            // source of buf lastuse values
+  struct bgroup *groups;
+  struct bgroup *spare;    // headers of reclaimed groups, for reuse
+  int ngroup;
+  int target;              // ngroup that bgrowidle() aims for
 } bcache;
 
+struct slabcache *bgroupcache;
+
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+static void
+blink(struct bucket *bk, struct buf *b)
+{
+  b->next = bk->head.next;
+  b->prev = &bk->head;
+  bk->head.next->prev = b;
+  bk->head.next = b;
+}
+
+// Add one group of buffers to the cache.
+// Returns 0 if out of memory.
+static int
+bgrow(void)
+{
+  struct bgroup *g;
+  struct buf *b;
+  uchar *page;
+
+  if((page = kalloc()) == 0)
+    return 0;
+  acquire(&bcache.lock);
+  if((g = bcache.spare) != 0)
+    bcache.spare = g->next;
+  release(&bcache.lock);
+  if(g == 0 && (g = slaballoc(bgroupcache)) == 0){
+    kfree(page);
+    return 0;
+  }
+  g->page = page;
+  for(int i = 0; i < BPERPAGE; i++){
+    b = &g->buf[i];
+    b->data = page + i*BSIZE;
+    b->valid = 0;
+    b->req.busy = 0;
+    b->dev = 0;
+    b->blockno = 0;
+    b->refcnt = 0;
+    b->lastuse = 0;
+    initsleeplock(&b->lock, "buffer");
+  }
+
+  // new buffers hold no block, so any bucket will do.
+  acquire(&bcache.lock);
+  acquire(&bcache.bucket[0].lock);
+  for(int i = 0; i < BPERPAGE; i++)
+    blink(&bcache.bucket[0], &g->buf[i]);
+  release(&bcache.bucket[0].lock);
+  g->next = bcache.groups;
+  bcache.groups = g;
+  bcache.ngroup++;
+  release(&bcache.lock);
+  return 1;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *bk;
+  uint64 nfree, ntotal;
+  int n;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
+  }
+  bgroupcache = slabcreate("bgroup", sizeof(struct bgroup));
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  kmemcount(&nfree, &ntotal);
+  n = nfree / BCACHEFRAC;
+  if(n < (NBUF + BPERPAGE - 1) / BPERPAGE)
+    n = (NBUF + BPERPAGE - 1) / BPERPAGE;
+  bcache.target = n;
+  while(bcache.ngroup < n)
+    if(!bgrow())
+      panic("binit");
+}
+
+// Free up to n groups whose buffers are all unused, but keep
+// at least NBUF buffers. Called by kalloc() when it is out of
+// memory, perhaps from inside the slab allocator, so it must not
+// allocate, and it keeps the group headers for bgrow() instead
+// of handing them back to their slab cache. Returns the number
+// of pages freed.
+int
+breclaim(int n)
+{
+  struct bgroup *g, **gp, *freed = 0, *last = 0;
+  int i, nfreed = 0;
+
+  acquire(&bcache.lock);
+  // bcache.lock keeps other threads from moving buffers, so
+  // taking every bucket lock, in order, cannot deadlock.
+  for(i = 0; i < NBUCKET; i++)
+    acquire(&bcache.bucket[i].lock);
+  for(gp = &bcache.groups; *gp && nfreed < n &&
+        (bcache.ngroup - 1) * BPERPAGE >= NBUF; ){
+    g = *gp;
+    for(i = 0; i < BPERPAGE && g->buf[i].refcnt == 0 &&
+          !g->buf[i].req.busy; i++)
+      ;
+    if(i < BPERPAGE){
+      gp = &g->next;
+      continue;
+    }
+    for(i = 0; i < BPERPAGE; i++)
+      bunlink(&g->buf[i]);
+    *gp = g->next;
+    g->next = freed;
+    freed = g;
+    bcache.ngroup--;
+    nfreed++;
+  }
+  for(i = NBUCKET-1; i >= 0; i--)
+    release(&bcache.bucket[i].lock);
+  release(&bcache.lock);
+
+  for(g = freed; g != 0; g = g->next){
+    for(i = 0; i < BPERPAGE; i++)
+      freelock(&g->buf[i].lock.lk);
+    kfree(g->page);
+    last = g;
+  }
+  if(last){
+    acquire(&bcache.lock);
+    last->next = bcache.spare;
+    bcache.spare = freed;
+    release(&bcache.lock);
+  }
+  return nfreed;
+}
+
+// Regrow the cache by one group toward its boot-time size,
+// if memory is plentiful. Called by idle CPUs from scheduler().
+// Returns 1 if it did any work.
+int
+bgrowidle(void)
+{
+  uint64 nfree, ntotal;
+
+  if(bcache.ngroup >= bcache.target)
+    return 0;
+  kmemcount(&nfree, &ntotal);
+  if(nfree < ntotal / 4)
+    return 0;
+  return bgrow();
+}
+
+// Look for the block in bucket bk, whose lock the caller holds.
+// If found, take a reference to it.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head.next; b != &bk->head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      return b;
+    }
   }
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -58,34 +246,116 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct bucket *bk = &bcache.bucket[BHASH(dev, blockno)];
+  struct bucket *vbk, *obk;
+  struct buf *b, *victim;
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  if((b = bfind(bk, dev, blockno)) != 0){
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  // Not cached. Only one recycler at a time; look again,
+  // since another may have cached the block meanwhile.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+
+  // Recycle the least recently used unused buffer,
+  // from whichever bucket it is in. Nobody else can
+  // move buffers, but they can take references, so
+  // check the victim again once its bucket is locked.
+  for(;;){
+    victim = 0;
+    vbk = 0;
+    for(obk = bcache.bucket; obk < bcache.bucket+NBUCKET; obk++){
+      if(obk != bk)
+        acquire(&obk->lock);
+      // the rearmost unused buffer is this bucket's LRU.
+      for(b = obk->head.prev; b != &obk->head; b = b->prev){
+        if(b->refcnt == 0){
+          if(victim == 0 || b->lastuse < victim->lastuse){
+            victim = b;
+            vbk = obk;
+          }
+          break;
+        }
+      }
+      if(obk != bk)
+        release(&obk->lock);
     }
+    if(victim == 0)
+      panic("bget: no buffers");
+
+    if(vbk != bk)
+      acquire(&vbk->lock);
+    if(victim->refcnt == 0)
+      break;
+    if(vbk != bk)
+      release(&vbk->lock);
   }
-  panic("bget: no buffers");
+
+  if(vbk != bk){
+    bunlink(victim);
+    release(&vbk->lock);
+    blink(bk, victim);
+  }
+  victim->dev = dev;
+  victim->blockno = blockno;
+  victim->valid = 0;
+  victim->refcnt = 1;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&victim->lock);
+  return victim;
+}
+
+// Set up r to move the n buffers in bv[], which must hold
+// consecutive blocks, once any read-ahead of them is done.
+// r's segments go in seg[].
+static void
+breq(struct diskreq *r, struct diskseg *seg, struct buf **bv, int n, int write)
+{
+  if(n < 1 || n > NDRSEG)
+    panic("breq");
+  for(int i = 0; i < n; i++)
+    if(bv[i]->req.busy)
+      virtio_disk_waitreq(&bv[i]->req);
+  r->dev = bv[0]->dev;
+  r->blockno = bv[0]->blockno;
+  r->write = write;
+  r->nseg = n;
+  r->seg = seg;
+  for(int i = 0; i < n; i++){
+    if(bv[i]->dev != r->dev || bv[i]->blockno != r->blockno + i)
+      panic("breq: not consecutive");
+    seg[i].addr = bv[i]->data;
+    seg[i].len = BSIZE;
+  }
+  r->done = 0;
+  r->arg = 0;
+}
+
+// Read or write b, and wait for it.
+static void
+brw(struct buf *b, int write)
+{
+  uint64 t0 = trace_begin();
+
+  breq(&b->req, &b->req.seg1, &b, 1, write);
+  virtio_disk_submit(&b->req, 0);
+  virtio_disk_waitreq(&b->req);
+  trace_end(TR_DISKRW, t0, 0, b->blockno);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -95,83 +365,196 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
+  if(!b->valid && b->req.busy)
+    virtio_disk_waitreq(&b->req);  // being read ahead
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    brw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// A read started by breadahead() is done.
+static void
+readahead_done(struct diskreq *r)
+{
+  struct buf *b = r->arg;
+
+  b->valid = 1;
+  bioend(b);
+}
+
+// Start reading a block that will probably be needed soon,
+// without waiting for it. The pending read keeps a reference
+// to the buffer, which bioend() drops when the read is done,
+// so the buffer can't be recycled meanwhile. Does nothing if
+// the block is cached or being read. Returns -1 if the disk
+// queue is full.
+int
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(b->valid || b->req.busy){
+    brelse(b);
+    return 0;
+  }
+  bpin(b);  // the read's reference
+  breq(&b->req, &b->req.seg1, &b, 1, 0);
+  b->req.done = readahead_done;
+  b->req.arg = b;
+  if(virtio_disk_submit(&b->req, 1) < 0){
+    bunpin(b);
+    brelse(b);
+    return -1;
+  }
+  brelse(b);
+  return 0;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  brw(b, 1);
 }
 
-// Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Write the n locked buffers in bv[], which must hold
+// consecutive blocks, with as few disk requests as possible.
+// Submits them all before waiting; each request uses the
+// req of its first buffer.
 void
-brelse(struct buf *b)
+bwritev(struct buf **bv, int n)
+{
+  uint64 t0 = trace_begin();
+  struct diskseg seg[NDRSEG];  // reused: needed only until submitted
+  int i, m;
+
+  for(i = 0; i < n; i++)
+    if(!holdingsleep(&bv[i]->lock))
+      panic("bwritev");
+  for(i = 0; i < n; i += m){
+    m = n - i < NDRSEG ? n - i : NDRSEG;
+    breq(&bv[i]->req, seg, bv + i, m, 1);
+    virtio_disk_submit(&bv[i]->req, 0);
+  }
+  for(i = 0; i < n; i += m){
+    m = n - i < NDRSEG ? n - i : NDRSEG;
+    virtio_disk_waitreq(&bv[i]->req);
+  }
+  if(n > 0)
+    trace_end(TR_DISKRW, t0, 0, bv[0]->blockno);
+}
+
+// Write b's contents to block blockno of b's device
+// rather than to b's own block. b must be locked.
+// The log uses this to install a block from its log copy,
+// leaving the cached home block free to change meanwhile.
+void
+bwriteto(struct buf *b, uint blockno)
 {
+  uint64 t0 = trace_begin();
+
   if(!holdingsleep(&b->lock))
-    panic("brelse");
+    panic("bwriteto");
+  breq(&b->req, &b->req.seg1, &b, 1, 1);
+  b->req.blockno = blockno;
+  virtio_disk_submit(&b->req, 0);
+  virtio_disk_waitreq(&b->req);
+  trace_end(TR_DISKRW, t0, 0, blockno);
+}
 
-  releasesleep(&b->lock);
+// Drop a reference to b. If it was the last,
+// stamp b as the most recently used.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = __sync_fetch_and_add(&bcache.stamp, 1);
+    bunlink(b);
+    blink(bk, b);
   }
+  release(&bk->lock);
+}
 
-  release(&bcache.lock);
+// Release a locked buffer.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Called, from the disk interrupt handler,
+// when a read started by breadahead() is done.
+void
+bioend(struct buf *b)
+{
+  bput(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
+}
+
+// Read or write a page at blocks blk.. of dev as one disk
+// request, straight to or from the page, not via the cache.
+static void
+pageio(uint dev, char *page, uint blk, int write)
+{
+  struct diskreq r;
+
+  r.dev = dev;
+  r.blockno = blk;
+  r.write = write;
+  r.nseg = 1;
+  r.seg = &r.seg1;
+  r.seg1.addr = page;
+  r.seg1.len = PGSIZE;
+  r.done = 0;
+  r.arg = 0;
+  virtio_disk_submit(&r, 0);
+  virtio_disk_waitreq(&r);
 }
 
 /* NTU OS 2024 */
-/* Write 4096 bytes page to the eight consecutive 512-byte blocks starting at blk. */
+/* Write the 4096-byte page to the PGSIZE/BSIZE consecutive blocks starting at blk. */
 void write_page_to_disk(uint dev, char *page, uint blk) {
-  for (int i = 0; i < 8; i++) {
-    // disk
-    int offset = i * 512;
-    int blk_idx = blk + i;
-    struct buf *buffer = bget(ROOTDEV, blk_idx);
-    memmove(buffer->data, page + offset, 512);
-    bwrite(buffer);
-    brelse(buffer);
-  }
+  uint64 t0 = trace_begin();
+  pageio(dev, page, blk, 1);
+  trace_end(TR_PGWRITE, t0, 0, blk);
 }
 
 /* NTU OS 2024 */
-/* Read 4096 bytes from the eight consecutive 512-byte blocks starting at blk into page. */
+/* Read the PGSIZE/BSIZE consecutive blocks starting at blk into the 4096-byte page. */
 void read_page_from_disk(uint dev, char *page, uint blk) {
-  for (int i = 0; i < 8; i++) {
-    int offset = i * 512;
-    int blk_idx = blk + i;
-    struct buf *buffer = bread(ROOTDEV, blk_idx);
-    memmove(page + offset, buffer->data, 512);
-    brelse(buffer);
-  }
+  uint64 t0 = trace_begin();
+  pageio(dev, page, blk, 0);
+  trace_end(TR_PGREAD, t0, 0, blk);
 }
@@ -1,12 +1,34 @@
+// A disk request: the consecutive blocks from blockno,
+// moved to or from the nseg memory segments in seg[], in order.
+// See virtio_disk_submit().
+#define NDRSEG 32  // max segments per request
+
+struct diskseg {
+  void *addr;
+  uint len;    // a multiple of 512
+};
+
+struct diskreq {
+  uint dev;
+  uint blockno;
+  int write;
+  int nseg;
+  struct diskseg *seg;           // needed only until submitted
+  struct diskseg seg1;           // room for one segment
+  void (*done)(struct diskreq*); // if set, called when finished
+  void *arg;                     // for done()
+  int busy;                      // does disk "own" the request?
+};
+
 struct buf {
   int valid;   // has data been read from disk?
-  int disk;    // does disk "own" buf?
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint64 lastuse;   // bcache.stamp when last released
+  struct buf *prev; // bcache bucket list
   struct buf *next;
-  uchar data[BSIZE];
+  uchar *data;      // BSIZE bytes in a bcache page
+  struct diskreq req; // I/O in progress; req.busy while the disk owns buf
 };
-
@@ -1,21 +1,32 @@
 struct buf;
 struct context;
+struct diskreq;
 struct file;
 struct inode;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
+struct tlbbatch;
+struct vmstat;
+struct rusage;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwriteto(struct buf*, uint);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bioend(struct buf*);
+int             breadahead(uint, uint);
+int             bgrowidle(void);
+int             breclaim(int);
 void write_page_to_disk(uint dev, char *pg, uint blk);
 void read_page_from_disk(uint dev, char *pg, uint blk);
 
@@ -55,8 +66,6 @@ int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
-uint balloc_page(uint dev);
-void bfree_page(int dev, uint b);
 // ramdisk.c
 void            ramdiskinit(void);
 void            ramdiskintr(void);
@@ -64,8 +73,15 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_pages(int);
+void*           kalloc_zeroed(void);
 void            kfree(void *);
+void            kfree_pages(void *, int);
 void            kinit(void);
+void            kmemcount(uint64*, uint64*);
+void            kmemdump(void);
+uint64          kmemstat(uint64*);
+int             kzeroidle(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -76,6 +92,7 @@ void            end_op(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
+void            pipeinit(void);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
 
@@ -84,6 +101,12 @@ void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// prof.c
+void            profinit(void);
+int             profile(int, uint64, int);
+uint64          profscratch(int);
+int             proftick(void);
+
 // proc.c
 int             cpuid(void);
 void            exit(int);
@@ -93,6 +116,7 @@ void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+void            kthread(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -106,15 +130,37 @@ void            wakeup(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
+int             getrusage(int, struct rusage*);
 void            procdump(void);
 
+// start.c
+int             timertick(void);
+
+// swap.c
+uint            swapalloc(void);
+uint            swapareano(uint);
+uint            swapblockno(uint);
+uint            swapcount(void);
+void            swapfree(uint);
+void            swapinit(struct superblock*);
+void            swapread(uint, char*);
+void            swapwrite(uint, char*);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// slab.c
+void*           slaballoc(struct slabcache*);
+struct slabcache* slabcreate(char*, uint);
+void            slabfree(struct slabcache*, void*);
+void            slabinit(void);
+
 // spinlock.c
 void            acquire(struct spinlock*);
+void            freelock(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(uint64, int);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
@@ -126,6 +172,7 @@ int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
+void            copy_page(void*, const void*);
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
@@ -133,6 +180,8 @@ char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
+void            stringinit(void);
+void            zero_page(void*);
 
 // syscall.c
 int             argint(int, int*);
@@ -142,6 +191,19 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// tlb.c
+void            tlbbatch_init(struct tlbbatch*, pagetable_t);
+void            tlbbatch_add(struct tlbbatch*, uint64);
+void            tlbbatch_free(struct tlbbatch*, void*);
+void            tlbbatch_flush(struct tlbbatch*);
+void            tlbintr(void);
+
+// trace.c
+void            traceinit(void);
+int             traceread(uint64, uint64, int);
+uint64          trace_begin(void);
+void            trace_end(int, uint64, uint64, uint64);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -177,9 +239,14 @@ pte_t *select_a_victim(pagetable_t pgdir);
 void clearaccessbit(pagetable_t pgdir);
 int get_swapped_blk(pagetable_t pgdir, uint64 va);
 pte_t *walk(pagetable_t pagetable, uint64 va, int alloc);
+pte_t *walkrange(pagetable_t pagetable, uint64 va, uint64 end, int alloc, uint64 *n);
 void vmprint(pagetable_t pagetable);
 int madvise(uint64 va, uint64 length, int advice);
 void pgprint();
+void vmstatread(struct vmstat*);
+int pgsnap(pagetable_t pagetable, uint64 va, uint64 len, uint64 ubuf, int max);
+void uvmfootprint(pagetable_t pagetable, uint64 sz, uint64 *nres, uint64 *nswap, uint64 *npin);
+extern struct vmstat vmstats;
 
 
 // plic.c
@@ -190,14 +257,20 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
-void            virtio_disk_intr(void);
+int             virtio_disk_submit(struct diskreq *, int);
+void            virtio_disk_waitreq(struct diskreq *);
+void            virtio_disk_intr(int);
+uint            virtio_disk_size(uint);
 
 // paging.c
 int handle_pgfault();
 int demand_page(uint64 va);
 char *swap_page_from_pte(pte_t *pte);
+void swap_page_out(uint dp, char *pa);
 char *swap_page(pagetable_t pagetbl);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+// update a vmstats counter; see vmstat.h
+#define VMSTAT_ADD(f, n) __sync_fetch_and_add(&vmstats.f, (n))
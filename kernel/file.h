@@ -27,6 +27,9 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  uint nextbn;        // readi(): block a sequential reader wants next
+  uint rabn;          // readi(): first block not yet read ahead
 };
 
 // map major device number to device functions.
@@ -44,6 +44,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(&sb);
 }
 
 // Zero a block.
@@ -305,6 +306,8 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->nextbn = 0;
+    ip->rabn = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -403,6 +406,54 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Like bmap(), but return 0 rather than allocate
+// a block that isn't there.
+static uint
+bmapnoalloc(struct inode *ip, uint bn)
+{
+  uint addr;
+  struct buf *bp;
+
+  if(bn < NDIRECT)
+    return ip->addrs[bn];
+  bn -= NDIRECT;
+  if(bn < NINDIRECT && (addr = ip->addrs[NDIRECT]) != 0){
+    bp = bread(ip->dev, addr);
+    addr = ((uint*)bp->data)[bn];
+    brelse(bp);
+    return addr;
+  }
+  return 0;
+}
+
+// readi() is about to read block bn of ip. If the reads have
+// been sequential, start reading the next NREADAHEAD blocks
+// of the file, so they are cached by the time they're wanted.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint last, b, addr;
+
+  if(bn != ip->nextbn && bn + 1 != ip->nextbn){
+    // not sequential: start over.
+    ip->nextbn = bn + 1;
+    ip->rabn = bn + 1;
+    return;
+  }
+  ip->nextbn = bn + 1;
+  if(ip->rabn <= bn)
+    ip->rabn = bn + 1;
+
+  last = (ip->size - 1) / BSIZE;
+  for(b = ip->rabn; b <= bn + NREADAHEAD && b <= last; b++){
+    if((addr = bmapnoalloc(ip, b)) == 0)
+      break;
+    if(breadahead(ip->dev, addr) < 0)
+      break;  // disk queue full; try again on the next block
+  }
+  ip->rabn = b;
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -463,6 +514,7 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    readahead(ip, off/BSIZE);
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
@@ -671,55 +723,3 @@ nameiparent(char *path, char *name)
 {
   return namex(path, 1, name);
 }
-
-/* NTU OS 2024 */
-/* Similar to balloc, except allocates eight consecutive free blocks. */
-uint balloc_page(uint dev) {
-  for (int b = 0; b < sb.size; b += BPB) {
-    struct buf *bp = bread(dev, BBLOCK(b, sb));
-
-    for (int bi = 0; bi < BPB && b + bi < sb.size; bi += 8) {
-      uchar *bits = &bp->data[bi / 8];
-      if (*bits == 0) {
-        *bits |= 0xff; // Mark 8 consecutive blocks in use.
-        //log_write(bp);
-        brelse(bp);
-
-        for (int i = 0; i < 8; i += 1) {
-          bzero(dev, b + bi + i);
-        }
-
-        uint blockno = b + bi;
-        return blockno;
-      }
-    }
-
-    brelse(bp);
-  }
-  panic("balloc_page: out of blocks");
-}
-
-/* NTU OS 2024 */
-/* Free 8 disk blocks allocated from balloc_page(). */
-void bfree_page(int dev, uint blockno) {
-  if (blockno + 8 > sb.size) {
-    panic("bfree_page: blockno out of bound");
-  }
-
-  if ((blockno % 8) != 0) {
-    panic("bfree_page: blockno is not aligned");
-  }
-
-  int bi = blockno % BPB;
-  int b = blockno - bi;
-  struct buf *bp = bread(dev, BBLOCK(b, sb));
-  uchar *bits = &bp->data[bi / 8];
-
-  if (*bits != 0xff) {
-    panic("bfree_page: data bits are invalid");
-  }
-
-  *bits = 0;
-  //log_write(bp);
-  brelse(bp);
-}
@@ -1,6 +1,8 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or, with kalloc_pages(), naturally aligned runs of
+// 2^order pages up to 2MB.
 
 #include "types.h"
 #include "param.h"
@@ -14,29 +16,249 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// A free page or block. Blocks in the buddy free lists
+// are doubly linked so a buddy can be unlinked in O(1);
+// the per-CPU caches use only next.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
-struct {
+// The global pool is a binary buddy allocator over
+// [KERNBASE, PHYSTOP). Block addresses are aligned to their
+// size in physical memory, so an order-9 block can back a
+// 2MB megapage. pgstate[] holds, for the first page of each
+// free block, its order plus one, and zero for every other page.
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PA2PFN(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PFN2PA(pfn) ((struct run *)(KERNBASE + (uint64)(pfn) * PGSIZE))
+
+// Each CPU keeps a private cache of free pages so that
+// kalloc() and kfree() usually touch only that CPU's lock.
+// A cache refills from, and drains to, the global pool
+// KBATCH pages at a time; when both the cache and the
+// pool are empty, kalloc() steals half of another CPU's cache.
+#define KBATCH 32
+#define KCACHEMAX (2*KBATCH)
+
+struct kcache {
   struct spinlock lock;
   struct run *freelist;
+  int n;
+};
+
+struct {
+  struct spinlock lock;
+  struct run free[NKORDER];   // list heads, one per order
+  uint64 nfree[NKORDER];      // free blocks of each order
 } kmem;
 
+static uchar pgstate[NPAGE];
+
+struct kcache kcache[NCPU];
+
+// Pages zeroed ahead of time by idle CPUs, for kalloc_zeroed().
+#define KZEROMAX 64
+
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
+static void
+lst_init(struct run *l)
+{
+  l->next = l;
+  l->prev = l;
+}
+
+static void
+lst_push(struct run *l, struct run *r)
+{
+  r->next = l->next;
+  r->prev = l;
+  l->next->prev = r;
+  l->next = r;
+}
+
+static void
+lst_remove(struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+}
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(int i = 0; i < NKORDER; i++)
+    lst_init(&kmem.free[i]);
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
+// Return a block to the buddy pool, merging it with its
+// buddy for as long as the buddy is free too.
+// Caller holds kmem.lock.
+static void
+bfree(void *pa, int order)
+{
+  uint64 pfn = PA2PFN(pa), b;
+
+  while(order < NKORDER-1){
+    b = pfn ^ (1L << order);
+    if(b >= NPAGE || pgstate[b] != order+1)
+      break;
+    lst_remove(PFN2PA(b));
+    kmem.nfree[order]--;
+    pgstate[b] = 0;
+    pfn &= ~(1L << order);
+    order++;
+  }
+  pgstate[pfn] = order+1;
+  lst_push(&kmem.free[order], PFN2PA(pfn));
+  kmem.nfree[order]++;
+}
+
+// Take a block of 2^order pages from the buddy pool,
+// splitting a larger one if need be. Keeps the lower halves
+// and returns the top, so that, like the old single free
+// list, pages come out from high addresses down.
+// Caller holds kmem.lock.
+static void *
+balloc(int order)
+{
+  struct run *r;
+  uint64 pfn;
+  int o;
+
+  for(o = order; o < NKORDER; o++)
+    if(kmem.free[o].next != &kmem.free[o])
+      break;
+  if(o == NKORDER)
+    return 0;
+
+  r = kmem.free[o].next;
+  lst_remove(r);
+  kmem.nfree[o]--;
+  pfn = PA2PFN(r);
+  pgstate[pfn] = 0;
+  while(o > order){
+    o--;
+    pgstate[pfn] = o+1;
+    lst_push(&kmem.free[o], PFN2PA(pfn));
+    kmem.nfree[o]++;
+    pfn += 1L << o;
+  }
+  return (void*)PFN2PA(pfn);
+}
+
+// Hand [pa_start, pa_end) to the buddy pool in the
+// largest aligned blocks that fit.
 void
 freerange(void *pa_start, void *pa_end)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  uint64 pfn, epfn;
+  int order;
+
+  pfn = PA2PFN(PGROUNDUP((uint64)pa_start));
+  epfn = PA2PFN(PGROUNDDOWN((uint64)pa_end));
+  acquire(&kmem.lock);
+  while(pfn < epfn){
+    for(order = NKORDER-1; order > 0; order--)
+      if((pfn & ((1L << order) - 1)) == 0 && pfn + (1L << order) <= epfn)
+        break;
+    bfree(PFN2PA(pfn), order);
+    pfn += 1L << order;
+  }
+  release(&kmem.lock);
+}
+
+// Move up to n pages from the front of one list to another.
+// The caller holds the locks of both lists.
+// Returns the number of pages moved.
+static int
+kmove(struct run **from, int *fromn, struct run **to, int *ton, int n)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < n && *from; i++){
+    r = *from;
+    *from = r->next;
+    r->next = *to;
+    *to = r;
+  }
+  *fromn -= i;
+  *ton += i;
+  return i;
+}
+
+// Take half of some other CPU's cache; keep one page
+// for the caller and put the rest in this CPU's cache.
+// Called with interrupts off and no kcache lock held,
+// so two CPUs stealing from each other cannot deadlock.
+static struct run *
+ksteal(int id)
+{
+  struct kcache *c;
+  struct run *list = 0, *r;
+  int n = 0;
+
+  for(int i = 1; i < NCPU && n == 0; i++){
+    c = &kcache[(id + i) % NCPU];
+    acquire(&c->lock);
+    kmove(&c->freelist, &c->n, &list, &n, (c->n + 1) / 2);
+    release(&c->lock);
+  }
+  if(list == 0)
+    return 0;
+
+  r = list;
+  list = r->next;
+  n--;
+
+  c = &kcache[id];
+  acquire(&c->lock);
+  kmove(&list, &n, &c->freelist, &c->n, n);
+  release(&c->lock);
+  return r;
+}
+
+// Give every CPU's cached pages, and the pre-zeroed pages,
+// back to the buddy pool, so that they can merge into
+// larger blocks.
+static void
+kdrain(void)
+{
+  struct kcache *c;
+  struct run *r;
+
+  acquire(&kzero.lock);
+  acquire(&kmem.lock);
+  while((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    bfree(r, 0);
+  }
+  kzero.n = 0;
+  release(&kmem.lock);
+  release(&kzero.lock);
+
+  for(c = kcache; c < &kcache[NCPU]; c++){
+    acquire(&c->lock);
+    acquire(&kmem.lock);
+    while((r = c->freelist) != 0){
+      c->freelist = r->next;
+      bfree(r, 0);
+    }
+    c->n = 0;
+    release(&kmem.lock);
+    release(&c->lock);
+  }
 }
 
 // Free the page of physical memory pointed at by v,
@@ -46,20 +268,90 @@ freerange(void *pa_start, void *pa_end)
 void
 kfree(void *pa)
 {
+  struct kcache *c;
   struct run *r;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+#ifndef KALLOC_NOJUNK
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->n++;
+  if(c->n > KCACHEMAX){
+    acquire(&kmem.lock);
+    for(int i = 0; i < KBATCH; i++){
+      r = c->freelist;
+      c->freelist = r->next;
+      bfree(r, 0);
+    }
+    c->n -= KBATCH;
+    release(&kmem.lock);
+  }
+  release(&c->lock);
+  pop_off();
+}
+
+// Take a page from the pool of pre-zeroed pages, or 0 if empty.
+static struct run *
+kzeroget(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.n--;
+  }
+  release(&kzero.lock);
+  return r;
+}
+
+// Take a page, without filling it, from this CPU's cache,
+// the buddy pool or another CPU's cache.
+static struct run *
+kallocpage(void)
+{
+  struct kcache *c;
+  struct run *r;
+  int id;
+
+  push_off();
+  id = cpuid();
+  c = &kcache[id];
+  acquire(&c->lock);
+  if(c->freelist == 0){
+    // in the order balloc() gives them.
+    struct run **tail = &c->freelist;
+    acquire(&kmem.lock);
+    for(int i = 0; i < KBATCH && (r = balloc(0)) != 0; i++){
+      *tail = r;
+      tail = &r->next;
+      c->n++;
+    }
+    *tail = 0;
+    release(&kmem.lock);
+  }
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = ksteal(id);
+  pop_off();
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -70,13 +362,161 @@ kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
+  if((r = kallocpage()) == 0)
+    r = kzeroget();
+  if(r == 0 && breclaim(KBATCH) > 0)
+    r = kallocpage();
+#ifndef KALLOC_NOJUNK
   if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+    memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  return (void*)r;
+}
+
+// Allocate one zero-filled page, preferably one that
+// an idle CPU has already zeroed.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
 
+  if((r = kzeroget()) != 0){
+    r->next = 0;  // kzero links pages through the first word
+    return (void*)r;
+  }
+  if((r = kallocpage()) == 0 && breclaim(KBATCH) > 0)
+    r = kallocpage();
   if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+    zero_page(r);
   return (void*)r;
 }
+
+// Zero one free page into the pool, if the pool is not
+// full. Called by idle CPUs from scheduler().
+// Returns 1 if it did any work.
+int
+kzeroidle(void)
+{
+  struct run *r;
+
+  if(kzero.n >= KZEROMAX)
+    return 0;
+  if((r = kallocpage()) == 0)
+    return 0;
+  zero_page(r);
+
+  acquire(&kzero.lock);
+  if(kzero.n < KZEROMAX){
+    r->next = kzero.freelist;
+    kzero.freelist = r;
+    kzero.n++;
+    r = 0;
+  }
+  release(&kzero.lock);
+  if(r)
+    kfree(r);
+  return 1;
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their total size. Returns 0 if no such block is free.
+void *
+kalloc_pages(int order)
+{
+  void *pa;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order >= NKORDER)
+    return 0;
+
+  acquire(&kmem.lock);
+  pa = balloc(order);
+  release(&kmem.lock);
+  if(pa == 0){
+    // pages parked in the per-CPU caches may be
+    // keeping buddies apart.
+    kdrain();
+    acquire(&kmem.lock);
+    pa = balloc(order);
+    release(&kmem.lock);
+  }
+
+#ifndef KALLOC_NOJUNK
+  if(pa)
+    memset(pa, 5, PGSIZE << order); // fill with junk
+#endif
+  return pa;
+}
+
+// Free a block returned by kalloc_pages(order).
+void
+kfree_pages(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(order < 0 || order >= NKORDER ||
+     ((uint64)pa % (PGSIZE << order)) != 0 ||
+     (char*)pa < end || (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_pages");
+
+#ifndef KALLOC_NOJUNK
+  // Fill with junk to catch dangling refs.
+  memset(pa, 1, PGSIZE << order);
+#endif
+
+  acquire(&kmem.lock);
+  bfree(pa, order);
+  release(&kmem.lock);
+}
+
+// Fragmentation statistics: nfree[o] is set to the number
+// of free blocks of order o in the buddy pool. Returns the
+// number of pages sitting in the per-CPU caches and the
+// pre-zeroed pool.
+uint64
+kmemstat(uint64 *nfree)
+{
+  uint64 ncached = kzero.n;
+
+  for(int i = 0; i < NCPU; i++)
+    ncached += kcache[i].n;
+  acquire(&kmem.lock);
+  for(int o = 0; o < NKORDER; o++)
+    nfree[o] = kmem.nfree[o];
+  release(&kmem.lock);
+  return ncached;
+}
+
+// Set *nfree to the number of free pages, wherever they
+// are kept, and *ntotal to the number the allocator manages.
+void
+kmemcount(uint64 *nfree, uint64 *ntotal)
+{
+  uint64 n[NKORDER];
+
+  *nfree = kmemstat(n);
+  for(int o = 0; o < NKORDER; o++)
+    *nfree += n[o] << o;
+  *ntotal = (PHYSTOP - PGROUNDUP((uint64)end)) / PGSIZE;
+}
+
+// Print free memory by block order. For procdump.
+void
+kmemdump(void)
+{
+  uint64 nfree[NKORDER], ncached, total;
+
+  ncached = kmemstat(nfree);
+  total = ncached;
+  printf("free:");
+  for(int o = 0; o < NKORDER; o++){
+    printf(" %d", (int)nfree[o]);
+    total += nfree[o] << o;
+  }
+  printf(" blocks of 4K..%dK, %d cached; %d pages\n",
+         (PGSIZE << (NKORDER-1)) / 1024, (int)ncached, (int)total);
+}
@@ -0,0 +1,8 @@
+// Spinlock statistics, as returned by the lockstat() system call.
+struct lockstat {
+  char name[16];
+  uint64 id;         // the lock's address, to match up snapshots
+  uint64 nacquire;   // acquisitions
+  uint64 ncontend;   // acquisitions that had to spin
+  uint64 nspin;      // failed test-and-set attempts
+};
@@ -19,7 +19,23 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the commit thread has taken the log.
+//
+// Commits are done by a kernel thread, committer(), not by
+// end_op(). It waits for a moment with no FS system calls
+// active; with COMMITTICKS > 0 it then waits that many ticks
+// more, unless someone is waiting for log space, so that a burst
+// of small system calls becomes one group commit. It snapshots
+// the transaction's blocks into their cached log blocks, which
+// is quick, and only then lets new system calls start; they
+// build the next transaction in memory while the committer
+// writes and installs this one.
+//
+// So end_op() returns before its system call is on disk. A
+// crash leaves the file system consistent, but may lose system
+// calls that had already returned: the ones in the transaction
+// being built, and in the one being written, if its header
+// isn't on disk yet.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +44,7 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous, but end_op() doesn't wait for them.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -37,19 +53,28 @@ struct logheader {
   int block[LOGSIZE];
 };
 
+// The log holds sb.nlog-1 blocks, as mkfs decided,
+// up to LOGSIZE.
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // committer() is snapshotting, please wait.
+  int nwait;       // how many begin_op()s wait for log space.
   int dev;
-  struct logheader lh;
+  struct logheader lh;   // transaction being built
+
+  // private to committer().
+  struct logheader clh;  // transaction being committed
+  struct buf *lbuf[LOGSIZE]; // its log blocks, locked
+  struct buf *dbuf[LOGSIZE]; // its home blocks, pinned
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void committer(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -60,13 +85,16 @@ initlog(int dev, struct superblock *sb)
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  if (log.size - 1 > LOGSIZE)
+    panic("initlog: log too big");
   log.dev = dev;
   recover_from_log();
+  kthread("commit", committer);
 }
 
 // Copy committed blocks from log to their home location
 static void
-install_trans(int recovering)
+install_trans(void)
 {
   int tail;
 
@@ -75,8 +103,6 @@ install_trans(int recovering)
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
   }
@@ -96,18 +122,18 @@ read_head(void)
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write log header lh to disk.
 // This is the true point at which the
-// current transaction commits.
+// transaction commits.
 static void
-write_head(void)
+write_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
@@ -117,9 +143,9 @@ static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(1); // if committed, copy from log to disk
+  install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
 // called at the start of each FS system call.
@@ -130,9 +156,12 @@ begin_op(void)
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > log.size - 1){
       // this op might exhaust log space; wait for commit.
+      log.nwait++;
+      wakeup(&log.clh);
       sleep(&log, &log.lock);
+      log.nwait--;
     } else {
       log.outstanding += 1;
       release(&log.lock);
@@ -142,19 +171,17 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// wakes the commit thread if this was the last outstanding operation.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+    if(log.lh.n > 0)
+      wakeup(&log.clh);
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -162,49 +189,97 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Copy modified blocks from cache to their cached log blocks,
+// keeping the log blocks locked and the home blocks pinned
+// until the transaction is installed.
+static void
+snapshot(void)
+{
+  int tail;
+
+  for (tail = 0; tail < log.clh.n; tail++) {
+    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    struct buf *from = bread(log.dev, log.clh.block[tail]); // cache block
+    memmove(to->data, from->data, BSIZE);
+    log.lbuf[tail] = to;
+    log.dbuf[tail] = from;
+    brelse(from);  // still pinned by log_write()
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write the snapshot to the log. The log blocks are
+// consecutive, so this takes few disk requests.
 static void
 write_log(void)
+{
+  bwritev(log.lbuf, log.clh.n);
+}
+
+// Install the committed blocks at their home locations,
+// writing from the log blocks' cached copies: the home
+// blocks in the cache may already hold the next
+// transaction's changes.
+static void
+install_snapshot(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = 0; tail < log.clh.n; tail++) {
+    bwriteto(log.lbuf[tail], log.clh.block[tail]);
+    brelse(log.lbuf[tail]);
+    bunpin(log.dbuf[tail]);
   }
 }
 
+// The commit thread.
 static void
-commit()
+committer(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+  uint t0;
+
+  for(;;){
+    acquire(&log.lock);
+    while(log.lh.n == 0 || log.outstanding > 0)
+      sleep(&log.clh, &log.lock);
+    if(COMMITTICKS > 0 && log.nwait == 0){
+      // give more system calls a chance to join this commit.
+      release(&log.lock);
+      acquire(&tickslock);
+      t0 = ticks;
+      while(ticks - t0 < COMMITTICKS)
+        sleep(&ticks, &tickslock);
+      release(&tickslock);
+      acquire(&log.lock);
+      if(log.outstanding > 0){
+        release(&log.lock);
+        continue;
+      }
+    }
+    log.committing = 1;
+    log.clh = log.lh;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    release(&log.lock);
+
+    snapshot();
+
+    acquire(&log.lock);
+    log.committing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    write_log();          // Write the snapshot to the log
+    write_head(&log.clh); // Write header to disk -- the real commit
+    install_snapshot();   // Now install writes to home locations
+    log.clh.n = 0;
+    write_head(&log.clh); // Erase the transaction from the log
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// committer() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
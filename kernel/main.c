@@ -15,12 +15,16 @@ main()
   if(cpuid() == 0){
     consoleinit();
     printfinit();
+    stringinit();    // pick page zero/copy routines
+    traceinit();     // paging latency trace
+    profinit();      // sampling profiler
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    slabinit();      // small-object caches
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
@@ -29,6 +33,7 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe object cache
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
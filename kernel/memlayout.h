@@ -25,12 +25,17 @@
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
 
+// more virtio mmio interfaces follow, one page and one irq each.
+#define VIRTIO(i) (VIRTIO0 + (i)*0x1000)
+#define VIRTIO_IRQ(i) (VIRTIO0_IRQ + (i))
+
 #ifdef LAB_NET
 #define E1000_IRQ 33
 #endif
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // software interrupt pending
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
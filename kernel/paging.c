@@ -5,57 +5,91 @@
 #include "spinlock.h"
 #include "defs.h"
 #include "proc.h"
+#include "vmstat.h"
+#include "trace.h"
 
 /* NTU OS 2024 */
-/* Allocate eight consecutive disk blocks. */
-/* Save the content of the physical page in the pte */
-/* to the disk blocks and save the block-id into the */
-/* pte. */
+/* Allocate a swap slot (see swap.c) for the page in the */
+/* pte, and make the pte point at the slot, swapped and */
+/* not valid. Returns the page, which is not written yet: */
+/* the caller must flush the TLB (see tlb.c), so that no */
+/* hart can still store to it, then call swap_page_out(), */
+/* and charge the swap-out to the process that owns pte. */
 char *swap_page_from_pte(pte_t *pte) {
   char *pa = (char*) PTE2PA(*pte);
-  uint dp = balloc_page(ROOTDEV);
+  uint dp = swapalloc();
 
-  write_page_to_disk(ROOTDEV, pa, dp); // write this page to disk
   *pte = (BLOCKNO2PTE(dp) | PTE_FLAGS(*pte) | PTE_S) & ~PTE_V;
-
   return pa;
 }
 
+/* Write the page at pa to swap slot dp, as given to its */
+/* pte by swap_page_from_pte(), and free the page. */
+void swap_page_out(uint dp, char *pa) {
+  uint64 t0 = trace_begin();
+
+  swapwrite(dp, pa); // write this page to disk
+  kfree(pa);
+  VMSTAT_ADD(nswapout, 1);
+  VMSTAT_ADD(nswapped, 1);
+
+  trace_end(TR_SWAPOUT, t0, 0, dp);
+}
+
 /* NTU OS 2024 */
-/* Page fault handler */
-int handle_pgfault() {
-  /* Find the address that caused the fault */
-  /* TODO */
-  uint64 va = PGROUNDDOWN(r_stval());
+/* Bring the page at va of the current process into memory, */
+/* from swap if it was swapped out, else as a new zero page. */
+/* Returns -1 if va has no PTE. */
+int demand_page(uint64 va) {
   pte_t *pte = walk(myproc()->pagetable, va, 0);
 
   if (pte == 0) {
-    panic("handle_pgfault: walk failed");
+    return -1;
   }
-  // printf("handle_pgfault walk succeed, va = %p\n", va);
 
   if (*pte & PTE_S) {
 
     uint blockno = PTE2BLOCKNO(*pte);
     char *pa = kalloc();
+    if (pa == 0)
+      panic("demand_page(): kalloc() fault");
     *pte = PA2PTE(pa) | PTE_FLAGS(*pte);
-    memset((void *)PTE2PA(*pte), 0, PGSIZE);
-    begin_op();
-    read_page_from_disk(ROOTDEV, PTE2PA(*pte), blockno);
-    bfree_page(ROOTDEV, blockno);
-    end_op();
+    // no transaction: swap I/O is never logged (see swap.c),
+    // and copyin() may get here inside one.
+    swapread(blockno, (char *)PTE2PA(*pte));
+    swapfree(blockno);
     *pte = (*pte | PTE_V) & ~PTE_S;
+    VMSTAT_ADD(nmajflt, 1);
+    VMSTAT_ADD(nswapin, 1);
+    VMSTAT_ADD(nswapped, -1);
+    myproc()->nmajflt++;
+    myproc()->nswapin++;
 
   } else {
-    void *pa = kalloc();
+    void *pa = kalloc_zeroed();
     if (pa == 0)
-      panic("handle_pgfault(): kalloc() fault");
-    memset((void *)pa, 0, PGSIZE);
+      panic("demand_page(): kalloc() fault");
 
     int perm = PTE_W | PTE_R | PTE_X | PTE_U;
     mappages(myproc()->pagetable, va, PGSIZE, (uint64)pa, perm);
-    // printf("mappages done\n");
+    VMSTAT_ADD(nminflt, 1);
+    myproc()->nminflt++;
+  }
+
+  return 0;
+}
+
+/* NTU OS 2024 */
+/* Page fault handler */
+int handle_pgfault() {
+  uint64 t0 = trace_begin();
+  /* Find the address that caused the fault */
+  uint64 va = PGROUNDDOWN(r_stval());
+
+  if (demand_page(va) < 0) {
+    panic("handle_pgfault: walk failed");
   }
 
+  trace_end(TR_PGFAULT, t0, va, 0);
   return 0;
 }
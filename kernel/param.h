@@ -5,9 +5,16 @@
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define NDISK         3  // virtio disks: the root disk, then swap disks
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      254   // max data blocks in on-disk log (header block limit)
+#define LOGFRAC      16    // mkfs: the log is 1/LOGFRAC of the file system
+#define NBUF         (2*LOGSIZE+MAXOPBLOCKS*3)  // minimum size of disk block cache
+#define BCACHEFRAC   64    // disk block cache: 1/BCACHEFRAC of free memory
+#define NREADAHEAD   4     // blocks readi() reads ahead of a sequential reader
+#define COMMITTICKS  0     // ticks the log waits to group commits, if any
+#define FSSIZE       2000  // size of file system in blocks
+#define NSWAP        4096  // size of swap space after the file system, in blocks
 #define MAXPATH      128   // maximum file path name
+#define NKORDER      10    // buddy allocator orders: 4KB .. 2MB blocks
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vmstat.h"
 #include "fifo.h"
 #include "lru.h"
 
@@ -98,10 +99,10 @@ allocpid() {
 
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// with no pid or user memory, and return with p->lock held.
+// If there are no free procs, return 0.
 static struct proc*
-allocproc(void)
+allocslot(void)
 {
   struct proc *p;
 
@@ -116,9 +117,30 @@ allocproc(void)
   return 0;
 
 found:
-  p->pid = allocpid();
   p->state = USED;
 
+  // Set up new context to start executing at forkret,
+  // which returns to user space.
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)forkret;
+  p->context.sp = p->kstack + PGSIZE;
+
+  return p;
+}
+
+// Look in the process table for an UNUSED proc.
+// If found, initialize state required to run in the kernel
+// and return to user space, and return with p->lock held.
+// If there are no free procs, or a memory allocation fails, return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+
+  if((p = allocslot()) == 0)
+    return 0;
+  p->pid = allocpid();
+
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
@@ -134,12 +156,6 @@ found:
     return 0;
   }
 
-  // Set up new context to start executing at forkret,
-  // which returns to user space.
-  memset(&p->context, 0, sizeof(p->context));
-  p->context.ra = (uint64)forkret;
-  p->context.sp = p->kstack + PGSIZE;
-
   return p;
 }
 
@@ -162,6 +178,9 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->nminflt = p->nmajflt = 0;
+  p->nswapin = p->nswapout = 0;
+  p->kfn = 0;
   p->state = UNUSED;
 }
 
@@ -245,6 +264,38 @@ userinit(void)
   release(&p->lock);
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn();
+  panic("kthread returned");
+}
+
+// Start a process that runs fn in the kernel and never
+// returns to user space. fn must not return.
+// It has no pid, trapframe, or user page table, so
+// it uses nothing that user processes would have.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocslot()) == 0)
+    panic("kthread");
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -436,14 +487,18 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int found;
+
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
+    found = 0;
     for(p = proc; p < &proc[NPROC]; p++) {
       acquire(&p->lock);
       if(p->state == RUNNABLE) {
+        found = 1;
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
@@ -457,6 +512,11 @@ scheduler(void)
       }
       release(&p->lock);
     }
+
+    // nothing to run: zero a page for kalloc_zeroed(),
+    // or give the buffer cache back what breclaim() took.
+    if(!found && !kzeroidle())
+      bgrowidle();
   }
 }
 
@@ -621,6 +681,38 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Fill in *ru for the process with the given pid,
+// or the calling process if pid is 0.
+// Returns -1 if there is no such process.
+int
+getrusage(int pid, struct rusage *ru)
+{
+  struct proc *p;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED && p->state != ZOMBIE){
+      ru->nminflt = p->nminflt;
+      ru->nmajflt = p->nmajflt;
+      ru->nswapin = p->nswapin;
+      ru->nswapout = p->nswapout;
+      // another process may be changing its page table,
+      // without p->lock, so only walk the caller's own.
+      if(p == myproc())
+        uvmfootprint(p->pagetable, p->sz, &ru->nresident,
+                     &ru->nswapped, &ru->npinned);
+      else
+        ru->nresident = ru->nswapped = ru->npinned = 0;
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -636,6 +728,7 @@ procdump(void)
   };
   struct proc *p;
   char *state;
+  uint64 nres, nswap, npin;
 
   printf("\n");
   for(p = proc; p < &proc[NPROC]; p++){
@@ -646,6 +739,13 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    if(p->pagetable && p->state != ZOMBIE){
+      uvmfootprint(p->pagetable, p->sz, &nres, &nswap, &npin);
+      printf(" rss %d swap %d pin %d flt %d/%d swapio %d/%d",
+             (int)nres, (int)nswap, (int)npin, (int)p->nminflt,
+             (int)p->nmajflt, (int)p->nswapin, (int)p->nswapout);
+    }
     printf("\n");
   }
+  kmemdump();
 }
@@ -105,4 +105,11 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // If non-zero, a kernel thread running kfn
+
+  // paging event counts, for getrusage(); see vmstat.h.
+  uint64 nminflt;
+  uint64 nmajflt;
+  uint64 nswapin;
+  uint64 nswapout;
 };
@@ -0,0 +1,170 @@
+// Timer-driven sampling profiler.
+//
+// When the kernel is built with make PROFILE=1, every timer
+// interrupt on every CPU records where that CPU was. The timer
+// then also runs KPROF_DIV times faster than the scheduler tick.
+//
+// The machine-mode timervec takes the sample itself (mepc, and
+// whether it came from user mode) into the CPU's struct mprof,
+// since it runs even where supervisor interrupts are off, e.g.
+// while spinning in acquire(). proftick(), called by devintr()
+// once they are back on, moves those samples into the CPU's
+// sample ring, adding the pid of the process running then. Like
+// the trace rings in trace.c, a sample ring is written only by
+// its CPU with interrupts off, and is drained by
+// profile(PROF_READ); samples that arrive while a ring is full
+// are dropped.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+#include "prof.h"
+
+#ifdef KPROF
+
+#define NPROF 1024  // samples per CPU ring
+#define NMPROF 64   // machine-mode samples; timervec knows this too
+
+// Written by timervec, in machine mode; see profscratch().
+struct mprof {
+  uint64 head;
+  uint64 pc[NMPROF];    // mepc, | 1 if it was a user pc
+};
+
+struct profring {
+  uint head;    // written by owning CPU
+  uint tail;    // written by profile(PROF_READ)
+  uint ntick;   // timer interrupts, for proftick()
+  uint64 mtail; // next struct mprof sample to take
+  struct profsample s[NPROF];
+};
+
+struct {
+  struct spinlock lock;  // serializes readers and start/stop
+  int on;
+  struct profring ring[NCPU];
+} prof;
+
+struct mprof mprof[NCPU];
+
+void
+profinit(void)
+{
+  initlock(&prof.lock, "prof");
+}
+
+// For timerinit(): where hart's timervec keeps its samples.
+uint64
+profscratch(int hart)
+{
+  return (uint64)&mprof[hart];
+}
+
+// Take the samples timervec has made on this CPU since the last
+// call. Called from devintr() on a timer interrupt, with
+// interrupts off. Returns 1 if one of those timer interrupts
+// should also count as a scheduler tick.
+int
+proftick(void)
+{
+  struct profring *r = &prof.ring[cpuid()];
+  struct mprof *m = &mprof[cpuid()];
+  struct profsample *s;
+  struct proc *p;
+  uint64 head, pc;
+  int tick = 0;
+
+  // timervec may run at any time, but only on this CPU.
+  head = *(volatile uint64*)&m->head;
+  if(head - r->mtail > NMPROF){
+    // lapped: those samples are gone, but the ticks still count.
+    r->ntick += head - NMPROF - r->mtail;
+    r->mtail = head - NMPROF;
+  }
+  p = mycpu()->proc;
+  for(; r->mtail != head; r->mtail++){
+    pc = m->pc[r->mtail % NMPROF];
+    if(prof.on && r->head - r->tail < NPROF){
+      s = &r->s[r->head % NPROF];
+      s->pc = pc & ~1L;
+      s->pid = p ? p->pid : 0;
+      s->cpu = cpuid();
+      s->user = pc & 1;
+      s->pad = 0;
+      __sync_synchronize();  // publish the sample before head
+      r->head++;
+    }
+    if(++r->ntick % KPROF_DIV == 0)
+      tick = 1;
+  }
+  return tick;
+}
+
+int
+profile(int cmd, uint64 buf, int n)
+{
+  struct proc *p = myproc();
+  struct profring *r;
+  struct profsample s;
+  int copied = 0;
+
+  acquire(&prof.lock);
+  if(cmd == PROF_START){
+    prof.on = 0;
+    __sync_synchronize();
+    for(r = prof.ring; r < &prof.ring[NCPU]; r++)
+      r->tail = r->head;
+    prof.on = 1;
+  } else if(cmd == PROF_STOP){
+    prof.on = 0;
+  } else if(cmd == PROF_READ){
+    for(r = prof.ring; r < &prof.ring[NCPU]; r++){
+      while(copied < n && r->tail != r->head){
+        __sync_synchronize();  // read head before the sample
+        s = r->s[r->tail % NPROF];
+        __sync_synchronize();  // finish the read before freeing the slot
+        r->tail++;
+        release(&prof.lock);
+        if(copyout(p->pagetable, buf + copied*sizeof(s), (char*)&s, sizeof(s)) < 0)
+          return -1;
+        acquire(&prof.lock);
+        copied++;
+      }
+    }
+  } else {
+    copied = -1;
+  }
+  release(&prof.lock);
+  return copied;
+}
+
+#else
+
+void
+profinit(void)
+{
+}
+
+uint64
+profscratch(int hart)
+{
+  return 0;
+}
+
+int
+proftick(void)
+{
+  return 1;
+}
+
+int
+profile(int cmd, uint64 buf, int n)
+{
+  return -1;
+}
+
+#endif
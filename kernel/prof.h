@@ -0,0 +1,18 @@
+// Sampling profiler; see prof.c and profile().
+
+// profile() commands
+#define PROF_START 1  // discard old samples and start sampling
+#define PROF_STOP  2
+#define PROF_READ  3  // drain samples into the buffer
+
+// With make PROFILE=1, timer interrupts come KPROF_DIV times
+// as often, and every KPROF_DIV-th one is a scheduler tick.
+#define KPROF_DIV 10
+
+struct profsample {
+  uint64 pc;     // where the timer interrupt arrived
+  int pid;       // running when the sample was taken; 0 if idle
+  uchar cpu;
+  uchar user;    // 1 if pc is a user address
+  ushort pad;
+};
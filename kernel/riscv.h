@@ -14,6 +14,7 @@ r_mhartid()
 #define MSTATUS_MPP_S (1L << 11)
 #define MSTATUS_MPP_U (0L << 11)
 #define MSTATUS_MIE (1L << 3)    // machine-mode interrupt enable.
+#define MSTATUS_VS_INITIAL (1L << 9) // vector unit on, state clean.
 
 static inline uint64
 r_mstatus()
@@ -29,6 +30,17 @@ w_mstatus(uint64 x)
   asm volatile("csrw mstatus, %0" : : "r" (x));
 }
 
+// Machine ISA Register, misa: one bit per extension letter.
+#define MISA_V (1L << ('V' - 'A')) // vector extension
+
+static inline uint64
+r_misa()
+{
+  uint64 x;
+  asm volatile("csrr %0, misa" : "=r" (x) );
+  return x;
+}
+
 // machine exception program counter, holds the
 // instruction address to which a return from
 // exception will go.
@@ -331,6 +343,14 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries for one virtual address,
+// in every address space.
+static inline void
+sfence_vma_va(uint64 va)
+{
+  asm volatile("sfence.vma %0, zero" : : "r" (va));
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
@@ -354,7 +374,7 @@ sfence_vma()
 #define PTE2PA(pte) (((pte) >> 10) << 12)
 
 #define PTE2BLOCKNO(pte) ((pte) >> 10)
-#define BLOCKNO2PTE(blockno) ((blockno) << 10)
+#define BLOCKNO2PTE(blockno) ((uint64)(blockno) << 10)
 
 // Address in page table or page directory entry
 /* #define PTE_ADDR(pte)   ((uint64)(pte) & ~0x3FF) */
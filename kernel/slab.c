@@ -0,0 +1,197 @@
+// Slab allocator for small, fixed-size kernel objects.
+//
+// Each object type gets a slabcache from slabcreate(). A cache
+// carves kalloc() pages ("slabs") into equal-size objects; the
+// struct slab header sits at the start of its page, so slabfree()
+// finds an object's slab by rounding its address down.
+//
+// Each CPU has a small magazine of free objects per cache, used
+// with interrupts off and no lock, so most slaballoc()/slabfree()
+// calls touch neither the cache lock nor the page allocator. A
+// magazine refills from, and flushes to, the slabs MAGSIZE/2
+// objects at a time.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NSLABCACHE 8
+#define MAGSIZE    16
+
+struct slab {
+  struct slab *next;    // on the cache's partial or full list
+  void *freelist;       // free objects, chained through their first word
+  int nfree;
+};
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  uint size;            // object size, rounded up to 8 bytes
+  int perslab;          // objects per slab
+  struct slab *partial; // slabs with at least one free object
+  struct slab *full;
+  struct slab *empty;   // one spare, all-free slab
+  int nslab;            // pages held by this cache
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  struct slabcache cache[NSLABCACHE];
+  int n;
+} slabs;
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// Make a cache of objects of the given size.
+// Called once per object type, at boot.
+struct slabcache*
+slabcreate(char *name, uint size)
+{
+  struct slabcache *c;
+
+  size = (size + 7) & ~7;
+  if(size == 0 || sizeof(struct slab) + size > PGSIZE)
+    panic("slabcreate: size");
+
+  acquire(&slabs.lock);
+  if(slabs.n == NSLABCACHE)
+    panic("slabcreate: too many caches");
+  c = &slabs.cache[slabs.n++];
+  release(&slabs.lock);
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+  return c;
+}
+
+// Take one object from some slab, allocating a new
+// slab if none has room. Caller holds c->lock.
+static void*
+slabget(struct slabcache *c)
+{
+  struct slab *s;
+  char *p;
+  void *obj;
+
+  if((s = c->partial) == 0){
+    if((s = c->empty) != 0){
+      c->empty = 0;
+    } else {
+      if((s = (struct slab*)kalloc()) == 0)
+        return 0;
+      c->nslab++;
+      s->freelist = 0;
+      p = (char*)(s + 1);
+      for(int i = 0; i < c->perslab; i++, p += c->size){
+        *(void**)p = s->freelist;
+        s->freelist = p;
+      }
+      s->nfree = c->perslab;
+    }
+    s->next = 0;
+    c->partial = s;
+  }
+
+  obj = s->freelist;
+  s->freelist = *(void**)obj;
+  if(--s->nfree == 0){
+    c->partial = s->next;
+    s->next = c->full;
+    c->full = s;
+  }
+  return obj;
+}
+
+static void
+slabunlink(struct slab **l, struct slab *s)
+{
+  for(; *l; l = &(*l)->next){
+    if(*l == s){
+      *l = s->next;
+      return;
+    }
+  }
+  panic("slabunlink");
+}
+
+// Return one object to its slab. Caller holds c->lock.
+static void
+slabput(struct slabcache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->nfree == 0){
+    slabunlink(&c->full, s);
+    s->next = c->partial;
+    c->partial = s;
+  }
+  *(void**)obj = s->freelist;
+  s->freelist = obj;
+  if(++s->nfree == c->perslab){
+    slabunlink(&c->partial, s);
+    if(c->empty == 0){
+      c->empty = s;
+    } else {
+      c->nslab--;
+      kfree(s);
+    }
+  }
+}
+
+// Allocate an object from cache c.
+// Returns 0 if out of memory.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *obj = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slabget(c)) != 0)
+      m->obj[m->n++] = obj;
+    release(&c->lock);
+  }
+  if(m->n > 0)
+    obj = m->obj[--m->n];
+  pop_off();
+  return obj;
+}
+
+// Free an object returned by slaballoc(c).
+void
+slabfree(struct slabcache *c, void *obj)
+{
+  struct magazine *m;
+
+  if(obj == 0 || ((uint64)obj & 7) != 0)
+    panic("slabfree");
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slabput(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  pop_off();
+}
@@ -7,6 +7,28 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+// Every initialized lock is on this list, for lockstat().
+// freelock() takes off a lock whose memory is about to be reused;
+// initlock() a lock only once until then.
+static struct spinlock lock_locks = { .name = "locks" };
+static struct spinlock *locks;
+static int nlocks;
+
+void
+freelock(struct spinlock *lk)
+{
+  acquire(&lock_locks);
+  if(lk->prev)
+    lk->prev->next = lk->next;
+  else
+    locks = lk->next;
+  if(lk->next)
+    lk->next->prev = lk->prev;
+  nlocks--;
+  release(&lock_locks);
+}
 
 void
 initlock(struct spinlock *lk, char *name)
@@ -14,6 +36,18 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->nspin = 0;
+
+  acquire(&lock_locks);
+  lk->prev = 0;
+  lk->next = locks;
+  if(locks)
+    locks->prev = lk;
+  locks = lk;
+  nlocks++;
+  release(&lock_locks);
 }
 
 // Acquire the lock.
@@ -21,6 +55,8 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
@@ -29,8 +65,10 @@ acquire(struct spinlock *lk)
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
+  // Spins are counted locally: touching lk's cache line
+  // while spinning would only add to the contention.
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +78,13 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  // for lockstat(); the lock protects these.
+  lk->nacquire++;
+  if(spins){
+    lk->ncontend++;
+    lk->nspin += spins;
+  }
 }
 
 // Release the lock.
@@ -108,3 +153,46 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Copy a struct lockstat for each registered lock, at most n
+// of them, to user address addr. Returns the number copied, or -1.
+// With n == 0, returns how many locks there are, which grows and
+// shrinks with the buffer cache and the pipes open.
+// Copies a page of them at a time, since copyout() can't be
+// called holding lock_locks.
+int
+lockstat(uint64 addr, int n)
+{
+  struct lockstat *st;
+  struct spinlock *lk;
+  int i, m, copied = 0;
+
+  if(n == 0)
+    return nlocks;
+  if((st = kalloc()) == 0)
+    return -1;
+  while(copied < n){
+    // find where the last page left off; locks freed
+    // since then may make this skip or repeat a few.
+    acquire(&lock_locks);
+    for(lk = locks, i = 0; lk != 0 && i < copied; lk = lk->next)
+      i++;
+    for(m = 0; lk != 0 && m < PGSIZE/sizeof(*st) && copied+m < n; lk = lk->next, m++){
+      safestrcpy(st[m].name, lk->name, sizeof(st[m].name));
+      st[m].id = (uint64)lk;
+      st[m].nacquire = lk->nacquire;
+      st[m].ncontend = lk->ncontend;
+      st[m].nspin = lk->nspin;
+    }
+    release(&lock_locks);
+    if(m == 0)
+      break;
+    if(copyout(myproc()->pagetable, addr + copied*sizeof(*st), (char*)st, m*sizeof(*st)) < 0){
+      kfree(st);
+      return -1;
+    }
+    copied += m;
+  }
+  kfree(st);
+  return copied;
+}
@@ -5,5 +5,12 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For lockstat():
+  uint64 nacquire;   // acquisitions
+  uint64 ncontend;   // acquisitions that had to spin
+  uint64 nspin;      // failed test-and-set attempts
+  struct spinlock *next;  // on the list of all locks
+  struct spinlock *prev;
 };
 
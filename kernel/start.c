@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
+#include "prof.h"
 
 void main();
 void timerinit();
@@ -11,11 +12,14 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][8];
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
 
+// misa of the boot hart, which only machine mode can read.
+uint64 boot_misa;
+
 // entry.S jumps here in machine mode on stack0.
 void
 start()
@@ -26,6 +30,13 @@ start()
   x |= MSTATUS_MPP_S;
   w_mstatus(x);
 
+  // let supervisor mode use the vector unit, if any;
+  // see stringinit().
+  if(r_mhartid() == 0)
+    boot_misa = r_misa();
+  if(r_misa() & MISA_V)
+    w_mstatus(r_mstatus() | MSTATUS_VS_INITIAL);
+
   // set M Exception Program Counter to main, for mret.
   // requires gcc -mcmodel=medany
   w_mepc((uint64)main);
@@ -66,15 +77,24 @@ timerinit()
 
   // ask the CLINT for a timer interrupt.
   int interval = 1000000; // cycles; about 1/10th second in qemu.
+#ifdef KPROF
+  interval /= KPROF_DIV;  // sample faster; see proftick().
+#endif
   *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
   // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[5] : address of CLINT MSIP register, for IPIs.
+  // scratch[6] : set by timervec when the timer fires; see timertick().
+  // scratch[7] : where timervec keeps profiler samples, or 0.
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
   scratch[4] = interval;
+  scratch[5] = CLINT_MSIP(id);
+  scratch[6] = 0;
+  scratch[7] = profscratch(id);
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -83,6 +103,15 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer and software (IPI) interrupts.
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
+}
+
+// devintr() calls this on a supervisor software interrupt, which
+// timervec raises both for timer interrupts and for IPIs.
+// Returns 1 if the timer has fired since the last call.
+int
+timertick(void)
+{
+  return __sync_lock_test_and_set(&timer_scratch[cpuid()][6], 0) != 0;
 }
@@ -1,13 +1,44 @@
 #include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "defs.h"
+
+// The mem* functions below move a 64-bit word at a time, unrolled,
+// once the pointers are aligned, falling back to bytes for the ends
+// and for pointers that can never be aligned together. zero_page()
+// and copy_page() are for whole, aligned 4096-byte pages, and use
+// the vector unit when the kernel is built with RVV=1 and the hart
+// has one; see stringinit().
+
+#define WSIZE sizeof(uint64)
+#define WALIGNED(p) (((uint64)(p) & (WSIZE - 1)) == 0)
 
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
+  uint64 w, *wdst;
+  uint i = 0;
+
+  for(; i < n && !WALIGNED(cdst + i); i++)
     cdst[i] = c;
+
+  w = (uchar)c;
+  w |= w << 8;
+  w |= w << 16;
+  w |= w << 32;
+  for(; i + 4*WSIZE <= n; i += 4*WSIZE){
+    wdst = (uint64 *)(cdst + i);
+    wdst[0] = w;
+    wdst[1] = w;
+    wdst[2] = w;
+    wdst[3] = w;
   }
+  for(; i + WSIZE <= n; i += WSIZE)
+    *(uint64 *)(cdst + i) = w;
+
+  for(; i < n; i++)
+    cdst[i] = c;
   return dst;
 }
 
@@ -18,6 +49,18 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+
+  // skip equal words; the byte loop finds the difference.
+  if(((uint64)s1 & (WSIZE - 1)) == ((uint64)s2 & (WSIZE - 1))){
+    while(n > 0 && !WALIGNED(s1)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
+    }
+    while(n >= WSIZE && *(uint64 *)s1 == *(uint64 *)s2)
+      s1 += WSIZE, s2 += WSIZE, n -= WSIZE;
+  }
+
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -32,20 +75,61 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  int words;
 
   if(n == 0)
     return dst;
   
   s = src;
   d = dst;
+  words = ((uint64)s & (WSIZE - 1)) == ((uint64)d & (WSIZE - 1));
   if(s < d && s + n > d){
     s += n;
     d += n;
+    if(words){
+      while(n > 0 && !WALIGNED(d)){
+        *--d = *--s;
+        n--;
+      }
+      for(; n >= 4*WSIZE; n -= 4*WSIZE){
+        s -= 4*WSIZE;
+        d -= 4*WSIZE;
+        ((uint64 *)d)[3] = ((uint64 *)s)[3];
+        ((uint64 *)d)[2] = ((uint64 *)s)[2];
+        ((uint64 *)d)[1] = ((uint64 *)s)[1];
+        ((uint64 *)d)[0] = ((uint64 *)s)[0];
+      }
+      for(; n >= WSIZE; n -= WSIZE){
+        s -= WSIZE;
+        d -= WSIZE;
+        *(uint64 *)d = *(uint64 *)s;
+      }
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if(words){
+      while(n > 0 && !WALIGNED(d)){
+        *d++ = *s++;
+        n--;
+      }
+      for(; n >= 4*WSIZE; n -= 4*WSIZE){
+        ((uint64 *)d)[0] = ((uint64 *)s)[0];
+        ((uint64 *)d)[1] = ((uint64 *)s)[1];
+        ((uint64 *)d)[2] = ((uint64 *)s)[2];
+        ((uint64 *)d)[3] = ((uint64 *)s)[3];
+        s += 4*WSIZE;
+        d += 4*WSIZE;
+      }
+      for(; n >= WSIZE; n -= WSIZE){
+        *(uint64 *)d = *(uint64 *)s;
+        s += WSIZE;
+        d += WSIZE;
+      }
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -57,6 +141,121 @@ memcpy(void *dst, const void *src, uint n)
   return memmove(dst, src, n);
 }
 
+static void
+zero_page_words(void *pa)
+{
+  uint64 *p = (uint64 *) pa;
+
+  for(int i = 0; i < PGSIZE/WSIZE; i += 8){
+    p[i+0] = 0;
+    p[i+1] = 0;
+    p[i+2] = 0;
+    p[i+3] = 0;
+    p[i+4] = 0;
+    p[i+5] = 0;
+    p[i+6] = 0;
+    p[i+7] = 0;
+  }
+}
+
+static void
+copy_page_words(void *dst, const void *src)
+{
+  uint64 *d = (uint64 *) dst;
+  const uint64 *s = (const uint64 *) src;
+
+  for(int i = 0; i < PGSIZE/WSIZE; i += 8){
+    d[i+0] = s[i+0];
+    d[i+1] = s[i+1];
+    d[i+2] = s[i+2];
+    d[i+3] = s[i+3];
+    d[i+4] = s[i+4];
+    d[i+5] = s[i+5];
+    d[i+6] = s[i+6];
+    d[i+7] = s[i+7];
+  }
+}
+
+#ifdef RVV
+// The kernel doesn't save vector registers across context switches,
+// so these keep interrupts off while they use them.
+static void
+zero_page_rvv(void *pa)
+{
+  char *p = (char *) pa;
+  uint64 n = PGSIZE, vl;
+
+  push_off();
+  while(n > 0){
+    asm volatile(".option push\n"
+                 ".option arch, +v\n"
+                 "vsetvli %0, %1, e8, m8, ta, ma\n"
+                 "vmv.v.i v0, 0\n"
+                 "vse8.v v0, (%2)\n"
+                 ".option pop"
+                 : "=r" (vl) : "r" (n), "r" (p) : "memory");
+    p += vl;
+    n -= vl;
+  }
+  pop_off();
+}
+
+static void
+copy_page_rvv(void *dst, const void *src)
+{
+  char *d = (char *) dst;
+  const char *s = (const char *) src;
+  uint64 n = PGSIZE, vl;
+
+  push_off();
+  while(n > 0){
+    asm volatile(".option push\n"
+                 ".option arch, +v\n"
+                 "vsetvli %0, %1, e8, m8, ta, ma\n"
+                 "vle8.v v0, (%2)\n"
+                 "vse8.v v0, (%3)\n"
+                 ".option pop"
+                 : "=r" (vl) : "r" (n), "r" (s), "r" (d) : "memory");
+    s += vl;
+    d += vl;
+    n -= vl;
+  }
+  pop_off();
+}
+#endif
+
+static void (*zero_page_fn)(void *) = zero_page_words;
+static void (*copy_page_fn)(void *, const void *) = copy_page_words;
+
+// Pick the page routines for this machine.
+// Called once, by the boot hart.
+void
+stringinit(void)
+{
+#ifdef RVV
+  extern uint64 boot_misa;
+
+  if(boot_misa & MISA_V){
+    zero_page_fn = zero_page_rvv;
+    copy_page_fn = copy_page_rvv;
+  }
+#endif
+}
+
+// Zero the page-aligned 4096-byte page at pa.
+void
+zero_page(void *pa)
+{
+  zero_page_fn(pa);
+}
+
+// Copy the page-aligned 4096-byte page at src to dst.
+void
+copy_page(void *dst, const void *src)
+{
+  copy_page_fn(dst, src);
+}
+
 int
 strncmp(const char *p, const char *q, uint n)
 {
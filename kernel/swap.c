@@ -0,0 +1,216 @@
+//
+// Swap space, where paging.c keeps the pages it evicts.
+//
+// Swap areas are the swap space mkfs leaves after the file
+// system (sb.swapstart, sb.nswap), and any swap disks: virtio
+// disks after the root disk. Each area is divided into slots
+// of SWAPBLKS blocks, one page each. Which slots are in use is
+// kept only in memory, since swapped pages don't outlive a boot.
+//
+// swapalloc() takes a slot from the highest-priority areas that
+// have one free, round-robin among them, so with several swap
+// disks consecutive evictions are striped across them. Within
+// an area it is next-fit from the last slot handed out, so
+// consecutive evictions are sequential writes on each disk,
+// rather than refilling whatever holes swap-ins have left.
+//
+// A swap handle, as kept in a swapped-out PTE, is the area
+// number shifted by SWAPAREASHIFT, plus the slot's first block.
+// vmprint() shows only the block, via swapblockno().
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "fs.h"
+#include "vmstat.h"
+
+_Static_assert(SWAPBLKS * BSIZE == PGSIZE, "a swap slot must be a page");
+#define MAXSWAPSLOT (PGSIZE*8) // slots per area: one page of map
+#define SWAPAREASHIFT 28       // handle = area << SWAPAREASHIFT | block
+#define NSWAPAREA NDISK
+
+#define PRIO_FS    0  // swap space on the root disk
+#define PRIO_DISK  1  // swap disks: used first
+
+struct swaparea {
+  uint dev;
+  uint start;     // first block of slot 0
+  uint nslot;
+  uint nfree;
+  uint next;      // next-fit cursor
+  int prio;       // areas with higher prio are used first
+  uchar *map;     // a bit per slot: in use?
+};
+
+struct {
+  struct spinlock lock;
+  struct swaparea area[NSWAPAREA];
+  int narea;
+  int rr;         // area of the last allocation
+} swap;
+
+static void
+addarea(uint dev, uint start, uint nslot, int prio)
+{
+  struct swaparea *a;
+
+  if(nslot == 0)
+    return;
+  if(nslot > MAXSWAPSLOT)
+    nslot = MAXSWAPSLOT;
+  a = &swap.area[swap.narea++];
+  a->dev = dev;
+  a->start = start;
+  a->nslot = nslot;
+  a->nfree = nslot;
+  a->next = 0;
+  a->prio = prio;
+  if((a->map = kalloc_zeroed()) == 0)
+    panic("swapinit");
+}
+
+// Called by fsinit() once the superblock is known.
+void
+swapinit(struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  addarea(ROOTDEV, sb->swapstart, sb->nswap / SWAPBLKS, PRIO_FS);
+  for(uint dev = ROOTDEV + 1; dev < ROOTDEV + NDISK; dev++)
+    addarea(dev, 0, virtio_disk_size(dev) / SWAPBLKS, PRIO_DISK);
+}
+
+// Allocate a swap slot and return its handle.
+// Takes only a spinlock and logs nothing, so it may be
+// called anywhere, with no transaction.
+uint
+swapalloc(void)
+{
+  struct swaparea *a;
+  int i, ai, prio, found;
+  uint s;
+
+  acquire(&swap.lock);
+  found = 0;
+  prio = 0;
+  for(i = 0; i < swap.narea; i++){
+    a = &swap.area[i];
+    if(a->nfree > 0 && (!found || a->prio > prio)){
+      prio = a->prio;
+      found = 1;
+    }
+  }
+  if(!found)
+    panic("swapalloc: out of swap");
+
+  // the next area after the last one used, at that priority.
+  for(i = 1; i <= swap.narea; i++){
+    a = &swap.area[(swap.rr + i) % swap.narea];
+    if(a->nfree > 0 && a->prio == prio)
+      break;
+  }
+  ai = a - swap.area;
+  swap.rr = ai;
+
+  for(i = 0; i < a->nslot; i++){
+    s = (a->next + i) % a->nslot;
+    if((a->map[s/8] & (1 << (s%8))) == 0){
+      a->map[s/8] |= 1 << (s%8);
+      a->nfree--;
+      a->next = s + 1;
+      break;
+    }
+  }
+  release(&swap.lock);
+  VMSTAT_ADD(nswapslot, 1);
+  // not swap.rr: another swapalloc() may have changed it.
+  return ((uint)ai << SWAPAREASHIFT) | (a->start + s * SWAPBLKS);
+}
+
+// Find h's area and slot.
+static struct swaparea*
+swaplookup(uint h, uint *slot)
+{
+  struct swaparea *a;
+  uint blockno;
+
+  if((h >> SWAPAREASHIFT) >= swap.narea)
+    panic("swap: bad handle");
+  a = &swap.area[h >> SWAPAREASHIFT];
+  blockno = swapblockno(h);
+  if(blockno < a->start || blockno >= a->start + a->nslot * SWAPBLKS ||
+     (blockno - a->start) % SWAPBLKS != 0)
+    panic("swap: bad handle");
+  *slot = (blockno - a->start) / SWAPBLKS;
+  return a;
+}
+
+// The first block of h's slot on its area's disk.
+uint
+swapblockno(uint h)
+{
+  return h & ((1 << SWAPAREASHIFT) - 1);
+}
+
+// The number of h's swap area, for pgsnap().
+uint
+swapareano(uint h)
+{
+  return h >> SWAPAREASHIFT;
+}
+
+// Free the slot with handle h.
+// Doesn't sleep, so uvmunmap() may call it holding p->lock.
+void
+swapfree(uint h)
+{
+  struct swaparea *a;
+  uint s;
+
+  a = swaplookup(h, &s);
+  acquire(&swap.lock);
+  if((a->map[s/8] & (1 << (s%8))) == 0)
+    panic("swapfree: slot is not in use");
+  a->map[s/8] &= ~(1 << (s%8));
+  a->nfree++;
+  release(&swap.lock);
+  VMSTAT_ADD(nswapslot, -1);
+}
+
+// Write the page at pa to the slot with handle h.
+void
+swapwrite(uint h, char *pa)
+{
+  struct swaparea *a;
+  uint s;
+
+  a = swaplookup(h, &s);
+  write_page_to_disk(a->dev, pa, a->start + s * SWAPBLKS);
+}
+
+// Read the slot with handle h into the page at pa.
+void
+swapread(uint h, char *pa)
+{
+  struct swaparea *a;
+  uint s;
+
+  a = swaplookup(h, &s);
+  read_page_from_disk(a->dev, pa, a->start + s * SWAPBLKS);
+}
+
+// How many slots are free.
+uint
+swapcount(void)
+{
+  uint n = 0;
+
+  acquire(&swap.lock);
+  for(int i = 0; i < swap.narea; i++)
+    n += swap.area[i].nfree;
+  release(&swap.lock);
+  return n;
+}
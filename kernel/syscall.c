@@ -117,6 +117,12 @@ extern uint64 sys_madvise(void);
 #if defined(PG_REPLACEMENT_USE_FIFO) || defined(PG_REPLACEMENT_USE_LRU)
 extern uint64 sys_pgprint(void);
 #endif
+extern uint64 sys_vmstat(void);
+extern uint64 sys_pgsnap(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_traceread(void);
+extern uint64 sys_profile(void);
+extern uint64 sys_lockstat(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -153,6 +159,12 @@ static uint64 (*syscalls[])(void) = {
 #if defined(PG_REPLACEMENT_USE_FIFO) || defined(PG_REPLACEMENT_USE_LRU)
 [SYS_pgprint]   sys_pgprint,
 #endif
+[SYS_vmstat]    sys_vmstat,
+[SYS_pgsnap]    sys_pgsnap,
+[SYS_getrusage] sys_getrusage,
+[SYS_traceread] sys_traceread,
+[SYS_profile]   sys_profile,
+[SYS_lockstat]  sys_lockstat,
 };
 
 
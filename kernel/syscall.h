@@ -34,3 +34,9 @@
 #define SYS_vmprint  31
 #define SYS_madvise  32
 #define SYS_pgprint  33
+#define SYS_vmstat   34
+#define SYS_pgsnap   35
+#define SYS_getrusage 36
+#define SYS_traceread 37
+#define SYS_profile  38
+#define SYS_lockstat 39
@@ -107,3 +107,16 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  if(argint(1, &n) < 0)
+    return -1;
+  return lockstat(addr, n);
+}
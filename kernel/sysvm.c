@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "defs.h"
 #include "proc.h"
+#include "vmstat.h"
 
 /* NTU OS 2024 */
 /* Entry of vmprint() syscall. */
@@ -45,3 +46,80 @@ sys_pgprint(void)
   return 0;
 }
 #endif
+
+/* Entry of vmstat() syscall. */
+uint64
+sys_vmstat(void)
+{
+  uint64 addr;
+  struct vmstat st;
+
+  if (argaddr(0, &addr) < 0) return -1;
+
+  vmstatread(&st);
+  if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+/* Entry of pgsnap() syscall. */
+uint64
+sys_pgsnap(void)
+{
+  uint64 base, buf;
+  int len, n;
+
+  if (argaddr(0, &base) < 0) return -1;
+  if (argint(1, &len) < 0) return -1;
+  if (argaddr(2, &buf) < 0) return -1;
+  if (argint(3, &n) < 0) return -1;
+  if (len < 0 || n < 0) return -1;
+
+  return pgsnap(myproc()->pagetable, base, len, buf, n);
+}
+
+/* Entry of getrusage() syscall. */
+uint64
+sys_getrusage(void)
+{
+  int pid;
+  uint64 addr;
+  struct rusage ru;
+
+  if (argint(0, &pid) < 0) return -1;
+  if (argaddr(1, &addr) < 0) return -1;
+
+  if (getrusage(pid, &ru) < 0)
+    return -1;
+  if (copyout(myproc()->pagetable, addr, (char *)&ru, sizeof(ru)) < 0)
+    return -1;
+  return 0;
+}
+
+/* Entry of traceread() syscall. */
+uint64
+sys_traceread(void)
+{
+  uint64 hist, evs;
+  int n;
+
+  if (argaddr(0, &hist) < 0) return -1;
+  if (argaddr(1, &evs) < 0) return -1;
+  if (argint(2, &n) < 0) return -1;
+
+  return traceread(hist, evs, n);
+}
+
+/* Entry of profile() syscall. */
+uint64
+sys_profile(void)
+{
+  int cmd, n;
+  uint64 buf;
+
+  if (argint(0, &cmd) < 0) return -1;
+  if (argaddr(1, &buf) < 0) return -1;
+  if (argint(2, &n) < 0) return -1;
+
+  return profile(cmd, buf, n);
+}
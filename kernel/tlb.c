@@ -0,0 +1,142 @@
+// TLB shootdown.
+//
+// Code that clears PTE_V in a user page table, or otherwise revokes
+// a mapping, records the virtual addresses in a struct tlbbatch and
+// calls tlbbatch_flush() once when done. The flush runs sfence.vma
+// for each address on this hart, and asks every other hart that is
+// running the same page table to do the same with an IPI: a write
+// to that hart's CLINT software interrupt register, which timervec
+// in kernelvec.S passes on as a supervisor software interrupt, which
+// devintr() hands to tlbintr().
+//
+// The trampoline flushes the whole TLB whenever it switches to or
+// from a user page table, so the only harts that can hold stale
+// entries are those in user space with the same page table, i.e.
+// whose cpu->proc uses it.
+//
+// A page whose mapping was removed must not be reused until the
+// flush is done, so tlbbatch_free() defers its kfree() until then.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "tlb.h"
+
+// one round of IPIs at a time.
+struct {
+  int busy;                    // a round is in progress
+  struct tlbbatch *batch;      // what the targets should flush
+  volatile int pending[NCPU];  // targets that have yet to flush
+} shootdown;
+
+void
+tlbbatch_init(struct tlbbatch *tb, pagetable_t pagetable)
+{
+  tb->pagetable = pagetable;
+  tb->n = 0;
+  tb->freelist = 0;
+}
+
+// Note that the mapping of va in tb->pagetable has changed.
+void
+tlbbatch_add(struct tlbbatch *tb, uint64 va)
+{
+  if(tb->n < NTLBVA)
+    tb->va[tb->n] = PGROUNDDOWN(va);
+  if(tb->n <= NTLBVA)
+    tb->n++;
+}
+
+// kfree() the page at pa after the next flush.
+// The page's first word links the list.
+void
+tlbbatch_free(struct tlbbatch *tb, void *pa)
+{
+  *(void**)pa = tb->freelist;
+  tb->freelist = pa;
+}
+
+// flush this hart's TLB entries for tb.
+static void
+flushlocal(struct tlbbatch *tb)
+{
+  if(tb->n > NTLBVA){
+    sfence_vma();
+  } else {
+    for(int i = 0; i < tb->n; i++)
+      sfence_vma_va(tb->va[i]);
+  }
+}
+
+// Invalidate the addresses in tb on every hart that might have
+// them cached, then free the deferred pages, in one round of IPIs.
+// Must not be called holding a spinlock, since a target hart may
+// be spinning on it with interrupts off.
+void
+tlbbatch_flush(struct tlbbatch *tb)
+{
+  int targets[NCPU];
+  int ntargets = 0;
+  void *pa;
+
+  push_off();
+  if(mycpu()->noff != 1)
+    panic("tlbbatch_flush locks");
+
+  if(tb->n > 0){
+    int id = cpuid();
+
+    flushlocal(tb);
+    for(int i = 0; i < NCPU; i++){
+      struct proc *p = cpus[i].proc;
+      if(i != id && p != 0 && p->pagetable == tb->pagetable)
+        targets[ntargets++] = i;
+    }
+  }
+
+  if(ntargets > 0){
+    // another hart may be waiting for this one to flush,
+    // and interrupts are off, so serve it while spinning.
+    while(__sync_lock_test_and_set(&shootdown.busy, 1) != 0)
+      tlbintr();
+
+    shootdown.batch = tb;
+    for(int i = 0; i < ntargets; i++)
+      shootdown.pending[targets[i]] = 1;
+    __sync_synchronize();
+    for(int i = 0; i < ntargets; i++)
+      *(volatile uint32*)CLINT_MSIP(targets[i]) = 1;
+
+    for(int i = 0; i < ntargets; i++)
+      while(shootdown.pending[targets[i]])
+        ;
+    __sync_synchronize();
+    __sync_lock_release(&shootdown.busy);
+  }
+  pop_off();
+
+  while((pa = tb->freelist) != 0){
+    tb->freelist = *(void**)pa;
+    kfree(pa);
+  }
+  tb->n = 0;
+}
+
+// called by devintr() on a software interrupt.
+// flush if another hart has asked this one to.
+void
+tlbintr(void)
+{
+  int id = cpuid();
+
+  if(shootdown.pending[id] == 0)
+    return;
+  __sync_synchronize();
+  flushlocal(shootdown.batch);
+  __sync_synchronize();
+  shootdown.pending[id] = 0;
+}
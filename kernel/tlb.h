@@ -0,0 +1,10 @@
+// A batch of TLB invalidations for one address space; see tlb.c.
+
+#define NTLBVA 32  // beyond this many pages, flush the whole TLB
+
+struct tlbbatch {
+  pagetable_t pagetable; // address space whose mappings changed
+  int n;                 // number of addresses; > NTLBVA means all
+  uint64 va[NTLBVA];
+  void *freelist;        // pages to kfree() once no TLB can reach them
+};
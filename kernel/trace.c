@@ -0,0 +1,111 @@
+// Latency tracing for the paging and disk paths.
+//
+// A traced function calls trace_begin() on entry and trace_end()
+// on exit. trace_end() adds the elapsed CLINT_MTIME ticks to a
+// log2 histogram for the event, and appends a record to this
+// CPU's trace ring. Only this CPU, with interrupts off, writes
+// its ring, so recording takes no lock; traceread() drains the
+// rings and, when one is full, newer records are dropped and
+// counted instead.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+#define NTRACE 128  // records per CPU ring
+
+struct tracering {
+  uint head;        // next slot to write; written by owning CPU
+  uint tail;        // next slot to read; written by traceread()
+  struct traceevent ev[NTRACE];
+};
+
+struct {
+  struct spinlock lock;   // serializes readers
+  struct tracehist h;
+  struct tracering ring[NCPU];
+} tr;
+
+void
+traceinit(void)
+{
+  initlock(&tr.lock, "trace");
+}
+
+// Timestamp for a later trace_end().
+uint64
+trace_begin(void)
+{
+  return *(volatile uint64*)CLINT_MTIME;
+}
+
+void
+trace_end(int event, uint64 t0, uint64 va, uint64 blockno)
+{
+  uint64 t = *(volatile uint64*)CLINT_MTIME - t0;
+  struct tracering *r;
+  struct traceevent *e;
+  struct proc *p;
+  int i;
+
+  for(i = 0; i < NTRHIST-1 && (t >> (i+1)) != 0; i++)
+    ;
+  __sync_fetch_and_add(&tr.h.hist[event][i], 1);
+
+  p = myproc();
+  push_off();
+  r = &tr.ring[cpuid()];
+  if(r->head - r->tail == NTRACE){
+    __sync_fetch_and_add(&tr.h.ndropped, 1);
+  } else {
+    e = &r->ev[r->head % NTRACE];
+    e->event = event;
+    e->pid = p ? p->pid : 0;
+    e->va = va;
+    e->blockno = blockno;
+    e->start = t0;
+    e->cycles = t;
+    e->cpu = cpuid();
+    e->pad = 0;
+    __sync_synchronize();  // publish the record before head
+    r->head++;
+  }
+  pop_off();
+}
+
+// Copy the histograms to user address hist, if it is not 0, and
+// drain up to n ring records to user address evs. Returns the
+// number of records copied, or -1.
+int
+traceread(uint64 hist, uint64 evs, int n)
+{
+  struct proc *p = myproc();
+  struct tracering *r;
+  struct traceevent e;
+  int copied = 0;
+
+  if(hist && copyout(p->pagetable, hist, (char*)&tr.h, sizeof(tr.h)) < 0)
+    return -1;
+
+  acquire(&tr.lock);
+  for(r = tr.ring; r < &tr.ring[NCPU]; r++){
+    while(copied < n && r->tail != r->head){
+      __sync_synchronize();  // read head before the record
+      e = r->ev[r->tail % NTRACE];
+      __sync_synchronize();  // finish the read before freeing the slot
+      r->tail++;
+      release(&tr.lock);
+      if(copyout(p->pagetable, evs + copied*sizeof(e), (char*)&e, sizeof(e)) < 0)
+        return -1;
+      acquire(&tr.lock);
+      copied++;
+    }
+  }
+  release(&tr.lock);
+  return copied;
+}
@@ -0,0 +1,30 @@
+// Paging-path latency tracing; see trace.c and traceread().
+
+// traced events
+#define TR_PGFAULT   0  // handle_pgfault
+#define TR_SWAPOUT   1  // swap_page_out
+#define TR_PGREAD    2  // read_page_from_disk
+#define TR_PGWRITE   3  // write_page_to_disk
+#define TR_DISKRW    4  // virtio_disk_rw
+#define NTREVENT     5
+
+// hist[e][i] counts events e that took
+// [2^i, 2^(i+1)) CLINT_MTIME ticks; i = 0 includes 0.
+#define NTRHIST     32
+
+struct tracehist {
+  uint64 hist[NTREVENT][NTRHIST];
+  uint64 ndropped;  // records lost to full trace rings
+};
+
+// one trace ring record
+struct traceevent {
+  uint event;
+  int pid;       // 0 if no process
+  uint64 va;     // faulting address, or 0
+  uint64 blockno;
+  uint64 start;  // CLINT_MTIME at entry
+  uint64 cycles; // CLINT_MTIME ticks from entry to exit
+  uint cpu;
+  uint pad;
+};
@@ -190,8 +190,8 @@ devintr()
 
     if(irq == UART0_IRQ){
       uartintr();
-    } else if(irq == VIRTIO0_IRQ){
-      virtio_disk_intr();
+    } else if(irq >= VIRTIO_IRQ(0) && irq < VIRTIO_IRQ(NDISK)){
+      virtio_disk_intr(irq - VIRTIO_IRQ(0));
     } else if(irq){
       printf("unexpected interrupt irq=%d\n", irq);
     }
@@ -204,16 +204,28 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or an IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    // another hart may want this one's TLB flushed.
+    tlbintr();
+
+    if(!timertick())
+      return 1;
+
+    // sample for the profiler; with a fast profiling
+    // timer, only some interrupts are scheduler ticks.
+    if(!proftick())
+      return 1;
+
+    if(cpuid() == 0){
+      clockintr();
+    }
+
     return 2;
   } else {
     return 0;
@@ -5,6 +5,11 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// callers describe I/O with a struct diskreq (buf.h), queue as
+// many as they like with virtio_disk_submit(), and either wait
+// with virtio_disk_waitreq() or have the interrupt handler call
+// the request's done().
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -17,10 +22,16 @@
 #include "buf.h"
 #include "virtio.h"
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+// the address of virtio mmio register r of disk d.
+#define R(d, r) ((volatile uint32 *)((d)->base + (r)))
+
+// a submitter waiting for a descriptor; on its stack.
+struct dwait {
+  struct dwait *next;
+  int ready;       // a descriptor is reserved for it
+};
 
-static struct disk {
+struct disk {
   // the virtio driver and device mostly communicate through a set of
   // structures in RAM. pages[] allocates that memory. pages[] is a
   // global (instead of calls to kalloc()) because it must consist of
@@ -34,7 +45,7 @@ static struct disk {
   
   // the first region of pages[] is a set (not a ring) of DMA
   // descriptors, with which the driver tells the device where to read
-  // and write individual disk operations. there are NUM descriptors.
+  // and write individual disk operations. there are num descriptors.
   // most commands consist of a "chain" (a linked list) of a couple of
   // these descriptors.
   // points into pages[].
@@ -43,140 +54,219 @@ static struct disk {
   // next is a ring in which the driver writes descriptor numbers
   // that the driver would like the device to process.  it only
   // includes the head descriptor of each chain. the ring has
-  // NUM elements.
+  // num elements.
   // points into pages[].
   struct virtq_avail *avail;
 
   // finally a ring in which the device writes descriptor numbers that
   // the device has finished processing (just the head of each chain).
-  // there are NUM used ring entries.
+  // there are num used ring entries.
   // points into pages[].
   struct virtq_used *used;
 
   // our own book-keeping.
+  uint num;        // queue size, as negotiated with the device
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used[2..NUM].
+  uint16 freestk[NUM]; // the free descriptors, as a stack
+  int nfree;
+  int nreserved;   // free descriptors promised to woken waiters
+  struct dwait *waithead; // submitters waiting for a descriptor,
+  struct dwait *waittail; // first come, first served
+  uint16 used_idx; // we've looked this far in used[2..num].
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct diskreq *r;
     char status;
   } info[NUM];
 
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
+
+  // each request takes one descriptor, which points to an
+  // indirect table: the header, the data segments, and the
+  // status. one table per descriptor.
+  struct virtq_desc ind[NUM][NDRSEG+2];
   
   struct spinlock vdisk_lock;
+
+  uint64 base;     // mmio registers
+  int present;     // found a disk at base?
   
-} __attribute__ ((aligned (PGSIZE))) disk;
+} __attribute__ ((aligned (PGSIZE))) disk[NDISK];
+
+// the queue is at most NUM long, whatever the device allows:
+// pages[] holds the descriptors and avail ring in the first
+// page and the used ring in the second, as the legacy
+// interface's page alignment wants.
+_Static_assert((NUM & (NUM-1)) == 0, "NUM must be a power of two");
+_Static_assert(NUM*sizeof(struct virtq_desc) + sizeof(struct virtq_avail) <= PGSIZE,
+               "virtio descriptors and avail ring don't fit in a page");
+_Static_assert(sizeof(struct virtq_used) <= PGSIZE, "virtio used ring doesn't fit in a page");
+
+// disk[0] holds the file system, ROOTDEV; others are
+// optional, such as swap disks. each is on its own
+// virtio-mmio bus, with its own queue and interrupt.
+static struct disk*
+devdisk(uint dev)
+{
+  if(dev < ROOTDEV || dev >= ROOTDEV + NDISK || !disk[dev - ROOTDEV].present)
+    panic("virtio_disk: no such disk");
+  return &disk[dev - ROOTDEV];
+}
+
+static void virtio_disk_init1(struct disk *d);
 
 void
 virtio_disk_init(void)
+{
+  for(int i = 0; i < NDISK; i++){
+    disk[i].base = VIRTIO(i);
+    virtio_disk_init1(&disk[i]);
+  }
+  if(!disk[0].present)
+    panic("could not find virtio disk");
+}
+
+// set up d if there is a disk there.
+static void
+virtio_disk_init1(struct disk *d)
 {
   uint32 status = 0;
 
-  initlock(&disk.vdisk_lock, "virtio_disk");
+  initlock(&d->vdisk_lock, "virtio_disk");
 
-  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-     *R(VIRTIO_MMIO_VERSION) != 1 ||
-     *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
-    panic("could not find virtio disk");
+  if(*R(d, VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(d, VIRTIO_MMIO_VERSION) != 1 ||
+     *R(d, VIRTIO_MMIO_DEVICE_ID) != 2 ||
+     *R(d, VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    return;
   }
   
   status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   status |= VIRTIO_CONFIG_S_DRIVER;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // negotiate features
-  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  uint64 features = *R(d, VIRTIO_MMIO_DEVICE_FEATURES);
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  if((features & (1 << VIRTIO_RING_F_INDIRECT_DESC)) == 0)
+    panic("virtio disk has no indirect descriptors");
+  *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
-  *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
+  *R(d, VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
 
   // initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  *R(d, VIRTIO_MMIO_QUEUE_SEL) = 0;
+  uint32 max = *R(d, VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
-  if(max < NUM)
-    panic("virtio disk max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
-  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
+  // the largest power of two that both sides allow.
+  for(d->num = NUM; d->num > max; d->num /= 2)
+    ;
+  *R(d, VIRTIO_MMIO_QUEUE_NUM) = d->num;
+  memset(d->pages, 0, sizeof(d->pages));
+  *R(d, VIRTIO_MMIO_QUEUE_PFN) = ((uint64)d->pages) >> PGSHIFT;
 
   // desc = pages -- num * virtq_desc
   // avail = pages + 0x40 -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
-  disk.desc = (struct virtq_desc *) disk.pages;
-  disk.avail = (struct virtq_avail *)(disk.pages + NUM*sizeof(struct virtq_desc));
-  disk.used = (struct virtq_used *) (disk.pages + PGSIZE);
+  d->desc = (struct virtq_desc *) d->pages;
+  d->avail = (struct virtq_avail *)(d->pages + d->num*sizeof(struct virtq_desc));
+  d->used = (struct virtq_used *) (d->pages + PGSIZE);
+
+  // all num descriptors start out unused.
+  for(int i = d->num - 1; i >= 0; i--){
+    d->free[i] = 1;
+    d->freestk[d->nfree++] = i;
+  }
+
+  d->present = 1;
 
-  // all NUM descriptors start out unused.
-  for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+  // plic.c and trap.c arrange for interrupts from VIRTIO_IRQ(i).
+}
 
-  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+// Size of disk dev in blocks, or 0 if there is no such disk.
+uint
+virtio_disk_size(uint dev)
+{
+  struct disk *d;
+  uint64 sectors;
+
+  if(dev < ROOTDEV || dev >= ROOTDEV + NDISK || !disk[dev - ROOTDEV].present)
+    return 0;
+  d = &disk[dev - ROOTDEV];
+  // virtio_blk_config.capacity, in 512-byte sectors.
+  sectors = *R(d, VIRTIO_MMIO_CONFIG) | ((uint64)*R(d, VIRTIO_MMIO_CONFIG+4) << 32);
+  return sectors / (BSIZE / 512);
 }
 
 // find a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct disk *d)
 {
-  for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
-      return i;
-    }
-  }
-  return -1;
+  int i;
+
+  if(d->nfree == 0)
+    return -1;
+  i = d->freestk[--d->nfree];
+  d->free[i] = 0;
+  return i;
 }
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct disk *d, int i)
 {
-  if(i >= NUM)
+  if(i >= d->num)
     panic("free_desc 1");
-  if(disk.free[i])
+  if(d->free[i])
     panic("free_desc 2");
-  disk.desc[i].addr = 0;
-  disk.desc[i].len = 0;
-  disk.desc[i].flags = 0;
-  disk.desc[i].next = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  d->desc[i].addr = 0;
+  d->desc[i].len = 0;
+  d->desc[i].flags = 0;
+  d->desc[i].next = 0;
+  d->free[i] = 1;
+  d->freestk[d->nfree++] = i;
+
+  // hand it to the longest waiter.
+  struct dwait *w = d->waithead;
+  if(w){
+    if((d->waithead = w->next) == 0)
+      d->waittail = 0;
+    d->nreserved++;
+    w->ready = 1;
+    wakeup(w);
+  }
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct disk *d, int i)
 {
   while(1){
-    int flag = disk.desc[i].flags;
-    int nxt = disk.desc[i].next;
-    free_desc(i);
+    int flag = d->desc[i].flags;
+    int nxt = d->desc[i].next;
+    free_desc(d, i);
     if(flag & VRING_DESC_F_NEXT)
       i = nxt;
     else
@@ -184,105 +274,132 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
-static int
-alloc3_desc(int *idx)
+// Queue request r. Returns without waiting for it to finish:
+// see virtio_disk_waitreq() and r->done. If the queue has no
+// room, sleeps until it does, or returns -1 if nowait.
+// r->seg[] need only last until this returns.
+int
+virtio_disk_submit(struct diskreq *r, int nowait)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
+  struct disk *d = devdisk(r->dev);
+  uint64 sector = r->blockno * (BSIZE / 512);
+  int n = r->nseg;
+  int id;
+
+  if(n < 1 || n > NDRSEG)
+    panic("virtio_disk_submit");
+  for(int i = 0; i < n; i++)
+    if(r->seg[i].len == 0 || r->seg[i].len % 512 != 0)
+      panic("virtio_disk_submit: segment");
+
+  acquire(&d->vdisk_lock);
+
+  // allocate the descriptor. if there's none to spare, wait
+  // in line: free_desc() wakes waiters one at a time, in order,
+  // each with a descriptor reserved for it.
+  if(d->nfree - d->nreserved == 0 || d->waithead){
+    struct dwait w;
+
+    if(nowait){
+      release(&d->vdisk_lock);
       return -1;
     }
+    w.next = 0;
+    w.ready = 0;
+    if(d->waittail)
+      d->waittail->next = &w;
+    else
+      d->waithead = &w;
+    d->waittail = &w;
+    while(!w.ready)
+      sleep(&w, &d->vdisk_lock);
+    d->nreserved--;
   }
-  return 0;
-}
-
-void
-virtio_disk_rw(struct buf *b, int write)
-{
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  if((id = alloc_desc(d)) < 0)
+    panic("virtio_disk_submit: no descriptor");
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // one descriptor for type/reserved/sector, descriptors for the
+  // data, and one for a 1-byte status result. they go in id's
+  // indirect table; qemu's virtio-blk.c reads them.
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+  struct virtio_blk_req *buf0 = &d->ops[id];
+  struct virtq_desc *t = d->ind[id];
 
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
-
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
-
-  if(write)
+  if(r->write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  t[0].addr = (uint64) buf0;
+  t[0].len = sizeof(struct virtio_blk_req);
+  t[0].flags = VRING_DESC_F_NEXT;
+  t[0].next = 1;
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 1; i <= n; i++){
+    t[i].addr = (uint64) r->seg[i-1].addr;
+    t[i].len = r->seg[i-1].len;
+    if(r->write)
+      t[i].flags = 0; // device reads the segment
+    else
+      t[i].flags = VRING_DESC_F_WRITE; // device writes it
+    t[i].flags |= VRING_DESC_F_NEXT;
+    t[i].next = i+1;
+  }
+
+  d->info[id].status = 0xff; // device writes 0 on success
+  t[n+1].addr = (uint64) &d->info[id].status;
+  t[n+1].len = 1;
+  t[n+1].flags = VRING_DESC_F_WRITE; // device writes the status
+  t[n+1].next = 0;
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  d->desc[id].addr = (uint64) t;
+  d->desc[id].len = (n+2) * sizeof(struct virtq_desc);
+  d->desc[id].flags = VRING_DESC_F_INDIRECT;
+  d->desc[id].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the request for virtio_disk_intr().
+  r->busy = 1;
+  d->info[id].r = r;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  d->avail->ring[d->avail->idx % d->num] = id;
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  d->avail->idx += 1; // not % num ...
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  *R(d, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
-  }
+  release(&d->vdisk_lock);
+  return 0;
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// Wait for request r to finish.
+void
+virtio_disk_waitreq(struct diskreq *r)
+{
+  struct disk *d = devdisk(r->dev);
 
-  release(&disk.vdisk_lock);
+  acquire(&d->vdisk_lock);
+  while(r->busy)
+    sleep(r, &d->vdisk_lock);
+  release(&d->vdisk_lock);
 }
 
 void
-virtio_disk_intr()
+virtio_disk_intr(int i)
 {
-  acquire(&disk.vdisk_lock);
+  struct disk *d = &disk[i];
+  struct diskreq *fin[NUM];
+  int nfin = 0;
+
+  acquire(&d->vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
@@ -290,26 +407,46 @@ virtio_disk_intr()
   // the "used" ring, in which case we may process the new
   // completion entries in this interrupt, and have nothing to do
   // in the next interrupt, which is harmless.
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  *R(d, VIRTIO_MMIO_INTERRUPT_ACK) = *R(d, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  // the device increments d->used->idx when it
+  // adds an entry to the used ring. reap every
+  // request it has finished, in one batch.
 
-  while(disk.used_idx != disk.used->idx){
+  while(d->used_idx != d->used->idx){
     __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+    int id = d->used->ring[d->used_idx % d->num].id;
 
-    if(disk.info[id].status != 0)
+    if(d->info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    struct diskreq *r = d->info[id].r;
+    d->info[id].r = 0;
+    free_chain(d, id);
+    if(r->done){
+      fin[nfin++] = r;
+    } else {
+      r->busy = 0;   // disk is done with the request
+      wakeup(r);
+    }
 
-    disk.used_idx += 1;
+    d->used_idx += 1;
   }
 
-  release(&disk.vdisk_lock);
+  release(&d->vdisk_lock);
+
+  // call done() without the lock, so that it may submit
+  // more requests. r stays busy until done() returns.
+  for(int j = 0; j < nfin; j++)
+    fin[j]->done(fin[j]);
+  if(nfin > 0){
+    acquire(&d->vdisk_lock);
+    for(int j = 0; j < nfin; j++){
+      fin[j]->busy = 0;
+      wakeup(fin[j]);
+    }
+    release(&d->vdisk_lock);
+  }
 }
@@ -8,6 +8,8 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "vm.h"
+#include "tlb.h"
+#include "vmstat.h"
 #include "fifo.h"
 #include "lru.h"
 #include "inttypes.h"
@@ -21,6 +23,9 @@ lru_t lru;
 queue_t q;
 #endif
 
+// event counters for vmstat(); see vmstatread().
+struct vmstat vmstats;
+
 /*
  * the kernel's page table.
  */
@@ -37,13 +42,16 @@ kvmmake(void)
   pagetable_t kpgtbl;
 
   kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  zero_page(kpgtbl);
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
   // virtio mmio disk interface
-  kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
+  kvmmap(kpgtbl, VIRTIO0, VIRTIO0, NDISK*PGSIZE, PTE_R | PTE_W);
+
+  // CLINT, for IPIs
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
 
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
@@ -80,41 +88,12 @@ kvminithart()
   sfence_vma();
 }
 
-// Return the address of the PTE in page table pagetable
-// that corresponds to virtual address va.  If alloc!=0,
-// create any required page-table pages.
-//
-// The risc-v Sv39 scheme has three levels of page-table
-// pages. A page-table page contains 512 64-bit PTEs.
-// A 64-bit virtual address is split into five fields:
-//   39..63 -- must be zero.
-//   30..38 -- 9 bits of level-2 index.
-//   21..29 -- 9 bits of level-1 index.
-//   12..20 -- 9 bits of level-0 index.
-//    0..11 -- 12 bits of byte offset within the page.
-pte_t *
-walk(pagetable_t pagetable, uint64 va, int alloc)
+// NTU OS 2024
+// pte, which maps va, is accessed, so determine how
+// it affects the page replacement buffer here.
+static void
+pgbuf_access(uint64 va, pte_t *pte)
 {
-  if(va >= MAXVA)
-    panic("walk");
-
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
-    if(*pte & PTE_V) {
-      pagetable = (pagetable_t)PTE2PA(*pte);
-    } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
-        return 0;
-      memset(pagetable, 0, PGSIZE);
-      *pte = PA2PTE(pagetable) | PTE_V;
-    }
-  }
-
-  pte_t *pte = &pagetable[PX(0, va)];
-
-  // NTU OS 2024
-  // pte is accessed, so determine how
-  // it affects the page replacement buffer here
   uint64 shifted_va = (va << 43) >> 55;
   if (!(shifted_va == 0 || shifted_va == 1 || shifted_va == 2)) {
     #ifdef PG_REPLACEMENT_USE_LRU
@@ -154,9 +133,78 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
 
     #endif
   }
+}
+
+// Return the address of the PTE in page table pagetable
+// that corresponds to virtual address va.  If alloc!=0,
+// create any required page-table pages.
+//
+// The risc-v Sv39 scheme has three levels of page-table
+// pages. A page-table page contains 512 64-bit PTEs.
+// A 64-bit virtual address is split into five fields:
+//   39..63 -- must be zero.
+//   30..38 -- 9 bits of level-2 index.
+//   21..29 -- 9 bits of level-1 index.
+//   12..20 -- 9 bits of level-0 index.
+//    0..11 -- 12 bits of byte offset within the page.
+pte_t *
+walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  if(va >= MAXVA)
+    panic("walk");
+
+  for(int level = 2; level > 0; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    if(*pte & PTE_V) {
+      pagetable = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
+        return 0;
+      *pte = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+
+  pte_t *pte = &pagetable[PX(0, va)];
+  pgbuf_access(va, pte);
   return pte;
 }
 
+// Like walk(), but for a range of pages [va, end): return the
+// address of the PTE for va, and set *n to the number of PTEs from
+// there to the end of the same page-table page, up to end, so the
+// caller can step through pte[0..*n-1] without walking again.
+// va must be page-aligned. If a page-table page is missing (and
+// alloc==0, or kalloc() fails), return 0 and set *n to the number
+// of pages up to the end of the missing subtree, or end, which
+// the caller can skip.
+// Unlike walk(), the caller calls pgbuf_access() on the PTEs it uses.
+pte_t *
+walkrange(pagetable_t pagetable, uint64 va, uint64 end, int alloc, uint64 *n)
+{
+  uint64 next;
+
+  if(va >= MAXVA || va >= end)
+    panic("walkrange");
+
+  for(int level = 2; level > 0; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    if(*pte & PTE_V) {
+      pagetable = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0){
+        next = (va | ((1L << PXSHIFT(level)) - 1)) + 1;
+        *n = (PGROUNDUP(next < end ? next : end) - va) / PGSIZE;
+        return 0;
+      }
+      *pte = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+
+  next = (va | ((1L << PXSHIFT(1)) - 1)) + 1;
+  *n = (PGROUNDUP(next < end ? next : end) - va) / PGSIZE;
+  return &pagetable[PX(0, va)];
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -196,64 +244,74 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  uint64 a, last;
+  uint64 a, end, n;
   pte_t *pte;
 
   if(size == 0)
     panic("mappages: size");
   a = PGROUNDDOWN(va);
-  last = PGROUNDDOWN(va + size - 1);
-  for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+  end = PGROUNDDOWN(va + size - 1) + PGSIZE;
+  while(a < end){
+    if((pte = walkrange(pagetable, a, end, 1, &n)) == 0)
       return -1;
-    if(*pte & PTE_V)
-      panic("mappages: remap");
-    *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
-      break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    for(; n > 0; n--, pte++){
+      pgbuf_access(a, pte);
+      if(*pte & PTE_V)
+        panic("mappages: remap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      a += PGSIZE;
+      pa += PGSIZE;
+    }
   }
   return 0;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Ranges without page-table pages are skipped.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end, n, i;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-
-    if(*pte & PTE_S) {
-      /* NTU OS 2024 */
-      /* int blockno = PTE2BLOCKNO(*pte); */
-      /* bfree_page(ROOTDEV, blockno); */
-      /* HACK: Do nothing here.
-         The wait() syscall holds holds the proc lock and calls into this method.
-         It causes bfree_page() to panic. Here we leak the swapped pages anyway.
-      */
+  end = va + npages*PGSIZE;
+  for(a = va; a < end; a += n*PGSIZE){
+    // nothing is mapped under a missing page-table page.
+    if((pte = walkrange(pagetable, a, end, 0, &n)) == 0)
       continue;
-    }
+    for(i = 0; i < n; i++, pte++){
+      pgbuf_access(a + i*PGSIZE, pte);
 
-    if((*pte & PTE_V) == 0)
-      continue;
+      if(*pte & PTE_P) {
+        *pte &= ~PTE_P;
+        VMSTAT_ADD(npinned, -1);
+      }
+
+      if(*pte & PTE_S) {
+        /* NTU OS 2024 */
+        /* wait() holds the proc lock here, which is */
+        /* fine since swapfree() doesn't sleep. */
+        swapfree(PTE2BLOCKNO(*pte));
+        *pte = 0;
+        VMSTAT_ADD(nswapped, -1);
+        continue;
+      }
 
-    if(PTE_FLAGS(*pte) == PTE_V)
-      panic("uvmunmap: not a leaf");
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      if((*pte & PTE_V) == 0)
+        continue;
+
+      if(PTE_FLAGS(*pte) == PTE_V)
+        panic("uvmunmap: not a leaf");
+      if(do_free){
+        uint64 pa = PTE2PA(*pte);
+        kfree((void*)pa);
+      }
+      *pte = 0;
     }
-    *pte = 0;
   }
 }
 
@@ -263,10 +321,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -280,8 +337,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -292,23 +348,28 @@ uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   char *mem;
-  uint64 a;
+  uint64 a, n;
+  pte_t *pte;
 
   if(newsz < oldsz)
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
-  for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
-    if(mem == 0){
+  for(a = oldsz; a < newsz; ){
+    if((pte = walkrange(pagetable, a, PGROUNDUP(newsz), 1, &n)) == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
-    if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
-      kfree(mem);
-      uvmdealloc(pagetable, a, oldsz);
-      return 0;
+    for(; n > 0; n--, pte++, a += PGSIZE){
+      mem = kalloc_zeroed();
+      if(mem == 0){
+        uvmdealloc(pagetable, a, oldsz);
+        return 0;
+      }
+      pgbuf_access(a, pte);
+      if(*pte & PTE_V)
+        panic("uvmalloc: remap");
+      *pte = PA2PTE(mem) | PTE_W|PTE_X|PTE_R|PTE_U|PTE_V;
     }
   }
   return newsz;
@@ -371,24 +432,33 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
-  uint64 pa, i;
+  pte_t *pte, *npte;
+  uint64 pa, i, n, end;
   uint flags;
   char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
+  end = PGROUNDUP(sz);
+  for(i = 0; i < end; ){
+    // old and new page-table pages cover the same n pages.
+    if((pte = walkrange(old, i, end, 0, &n)) == 0)
       panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    if((npte = walkrange(new, i, end, 1, &n)) == 0)
       goto err;
+    for(; n > 0; n--, pte++, npte++, i += PGSIZE){
+      pgbuf_access(i, pte);
+      if((*pte & PTE_V) == 0)
+        panic("uvmcopy: page not present");
+      pa = PTE2PA(*pte);
+      flags = PTE_FLAGS(*pte);
+      if((mem = kalloc()) == 0)
+        goto err;
+      copy_page(mem, (char*)pa);
+      pgbuf_access(i, npte);
+      if(*npte & PTE_V)
+        panic("uvmcopy: remap");
+      *npte = PA2PTE(mem) | flags | PTE_V;
+      if(flags & PTE_P)
+        VMSTAT_ADD(npinned, 1);
     }
   }
   return 0;
@@ -410,27 +480,125 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// copyout(), copyin() and copyinstr() translate user addresses
+// through a ucursor, which remembers the level-0 page-table page
+// of the last translation, so a copy spanning many pages walks
+// from the root only once per 2 MB.
+struct ucursor {
+  pagetable_t pagetable;
+  uint64 base;   // first va mapped by leaf
+  pte_t *leaf;   // level-0 page-table page, or 0
+};
+
+// Can the caller sleep to fault in a page? Not if it holds a
+// spinlock, as pipewrite() and wait() do around their copies.
+static int
+cansleep(void)
+{
+  int ok;
+
+  push_off();
+  ok = mycpu()->noff == 1;
+  pop_off();
+  return ok;
+}
+
+// Return the level-0 PTE for va (page-aligned) in c->pagetable,
+// or 0 if there is no level-0 page-table page for it.
+static pte_t *
+uvmpte(struct ucursor *c, uint64 va)
+{
+  pte_t *pte;
+  uint64 n;
+
+  if(c->leaf == 0 || va - c->base >= (1L << PXSHIFT(1))){
+    c->base = va & ~((1L << PXSHIFT(1)) - 1);
+    c->leaf = 0;
+    if((pte = walkrange(c->pagetable, va, va + PGSIZE, 0, &n)) != 0)
+      c->leaf = pte - PX(0, va);
+  }
+  return c->leaf ? &c->leaf[PX(0, va)] : 0;
+}
+
+// Return the physical address of the user page at va (page-aligned)
+// in c->pagetable, or 0 if there isn't one. A page of the current
+// process that is swapped out, or within p->sz but not yet
+// allocated, is faulted in first.
+static uint64
+uvmtranslate(struct ucursor *c, uint64 va)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    return 0;
+
+  for(;;){
+    pte = uvmpte(c, va);
+    if(pte && (*pte & PTE_V)){
+      pgbuf_access(va, pte);
+      if((*pte & PTE_U) == 0)
+        return 0;
+      return PTE2PA(*pte);
+    }
+
+    if(pte == 0 || p == 0 || c->pagetable != p->pagetable || !cansleep())
+      return 0;
+    if((*pte & PTE_S) == 0 && va >= p->sz)
+      return 0;
+    if(demand_page(va) < 0)
+      return 0;
+  }
+}
+
+// Translate the user range [va, va+len) and return the physical
+// address of va, with *n set to the number of bytes from there
+// that are physically contiguous (at most len), which may span
+// several pages. Returns 0 if va is not a user address.
+// Pages after the first are only taken if they are already
+// resident, so each page is faulted in and counted as accessed
+// once, by the call that starts on it.
+static uint64
+uvmspan(struct ucursor *c, uint64 va, uint64 len, uint64 *n)
+{
+  uint64 va0, pa0;
+  pte_t *pte;
+
+  va0 = PGROUNDDOWN(va);
+  if((pa0 = uvmtranslate(c, va0)) == 0)
+    return 0;
+  *n = PGSIZE - (va - va0);
+  while(*n < len){
+    va0 += PGSIZE;
+    if(va0 >= MAXVA || (pte = uvmpte(c, va0)) == 0 ||
+       (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U) ||
+       PTE2PA(*pte) != pa0 + (va0 - PGROUNDDOWN(va)))
+      break;
+    pgbuf_access(va0, pte);
+    *n += PGSIZE;
+  }
+  if(*n > len)
+    *n = len;
+  return pa0 + (va - PGROUNDDOWN(va));
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
-  uint64 n, va0, pa0;
+  struct ucursor c = { pagetable, 0, 0 };
+  uint64 n, pa;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa = uvmspan(&c, dstva, len, &n)) == 0)
       return -1;
-    n = PGSIZE - (dstva - va0);
-    if(n > len)
-      n = len;
-    memmove((void *)(pa0 + (dstva - va0)), src, n);
+    memmove((void *)pa, src, n);
 
     len -= n;
     src += n;
-    dstva = va0 + PGSIZE;
+    dstva += n;
   }
   return 0;
 }
@@ -441,25 +609,45 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  uint64 n, va0, pa0;
+  struct ucursor c = { pagetable, 0, 0 };
+  uint64 n, pa;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa = uvmspan(&c, srcva, len, &n)) == 0)
       return -1;
-    n = PGSIZE - (srcva - va0);
-    if(n > len)
-      n = len;
-    memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    memmove(dst, (void *)pa, n);
 
     len -= n;
     dst += n;
-    srcva = va0 + PGSIZE;
+    srcva += n;
   }
   return 0;
 }
 
+// Return the length of the string at s, or max if there is
+// no '\0' in the first max bytes. Once s is aligned, checks a
+// word at a time; an aligned word never crosses a page.
+static uint64
+strnlen_word(const char *s, uint64 max)
+{
+  const uint64 ones = 0x0101010101010101UL;
+  const uint64 highs = 0x8080808080808080UL;
+  uint64 i = 0;
+
+  for(; i < max && ((uint64)(s + i) % sizeof(uint64)) != 0; i++)
+    if(s[i] == '\0')
+      return i;
+  for(; i + sizeof(uint64) <= max; i += sizeof(uint64)){
+    uint64 w = *(uint64 *)(s + i);
+    if((w - ones) & ~w & highs)
+      break;  // some byte of w is zero
+  }
+  for(; i < max; i++)
+    if(s[i] == '\0')
+      return i;
+  return max;
+}
+
 // Copy a null-terminated string from user to kernel.
 // Copy bytes to dst from virtual address srcva in a given page table,
 // until a '\0', or max.
@@ -467,40 +655,45 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
-  int got_null = 0;
+  struct ucursor c = { pagetable, 0, 0 };
+  uint64 n, m, pa;
 
-  while(got_null == 0 && max > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+  while(max > 0){
+    // a page at a time: the string may end in this one.
+    m = PGSIZE - (srcva - PGROUNDDOWN(srcva));
+    if((pa = uvmspan(&c, srcva, m < max ? m : max, &n)) == 0)
       return -1;
-    n = PGSIZE - (srcva - va0);
-    if(n > max)
-      n = max;
-
-    char *p = (char *) (pa0 + (srcva - va0));
-    while(n > 0){
-      if(*p == '\0'){
-        *dst = '\0';
-        got_null = 1;
-        break;
-      } else {
-        *dst = *p;
-      }
-      --n;
-      --max;
-      p++;
-      dst++;
+
+    m = strnlen_word((char *)pa, n);
+    memmove(dst, (void *)pa, m);
+    if(m < n){
+      dst[m] = '\0';
+      return 0;
     }
 
-    srcva = va0 + PGSIZE;
-  }
-  if(got_null){
-    return 0;
-  } else {
-    return -1;
+    max -= n;
+    dst += n;
+    srcva += n;
   }
+  return -1;
+}
+
+// Pages taken out of the page table by madvise(MADV_DONTNEED)
+// that have yet to be written to swap.
+#define NSWAPOUT 16
+struct swapout {
+  char *pa;
+  uint dp;     // its swap slot
+};
+
+// Flush tb's TLB entries, and only then write out and
+// free the n pages in out[], which tb has unmapped.
+static void
+swapout_flush(struct tlbbatch *tb, struct swapout *out, int n)
+{
+  tlbbatch_flush(tb);
+  for (int i = 0; i < n; i++)
+    swap_page_out(out[i].dp, out[i].pa);
 }
 
 /* NTU OS 2024 */
@@ -519,106 +712,129 @@ int madvise(uint64 base, uint64 len, int advice) {
 
   uint64 begin = PGROUNDDOWN(base);
   uint64 last = PGROUNDDOWN(base + len - 1);
+  uint64 end = last + PGSIZE;
+
+  // each loop below walks the page table once per
+  // page-table page, and visits its PTEs in turn.
+  uint64 va, n;
+  pte_t *pte;
 
   if (advice == MADV_NORMAL) {
     return 0;
   } else if (advice == MADV_WILLNEED) {
 
-    for (uint64 va = begin; va <= last; va += PGSIZE) {
-      pte_t *pte = walk(pgtbl, va, 0);
-
-      if (pte != 0 && (*pte & PTE_S)) {
-        // char *pa = (char *) PTE2PA(*pte);
-        uint64 blockno = PTE2BLOCKNO(*pte);
-        char *pa = kalloc();
-        *pte = PA2PTE(pa) | PTE_FLAGS(*pte);
-        memset((void *)PTE2PA(*pte), 0, PGSIZE);
-
-        begin_op();
-        read_page_from_disk(ROOTDEV, PTE2PA(*pte), blockno);
-        bfree_page(ROOTDEV, blockno);
-        end_op();
-
-        *pte = (*pte | PTE_V) & ~PTE_S;
-      }
-      else if (pte != 0 && !(*pte & PTE_V)) {
-        char *pa = kalloc();
-        // *pte = PA2PTE((uint64)kalloc()) | PTE_W ;
-        // *pte |= PTE_X;
-        // *pte |= PTE_R;
-        // *pte |= PTE_U;
-        memset(pa, 0, PGSIZE);
-        // *pte |= PTE_V;
-        mappages(pgtbl, base, PGSIZE, (uint64)pa, PTE_W | PTE_X | PTE_R | PTE_U);
+    for (va = begin; va < end; va += n * PGSIZE) {
+      if ((pte = walkrange(pgtbl, va, end, 0, &n)) == 0)
+        continue;
+      for (uint64 i = 0; i < n; i++, pte++) {
+        uint64 va0 = va + i * PGSIZE;
+        pgbuf_access(va0, pte);
+
+        if (*pte & PTE_S) {
+          // char *pa = (char *) PTE2PA(*pte);
+          uint64 blockno = PTE2BLOCKNO(*pte);
+          char *pa = kalloc();
+          if (pa == 0)
+            return -1;  // the page stays in swap
+          *pte = PA2PTE(pa) | PTE_FLAGS(*pte);
+
+          swapread(blockno, (char *)PTE2PA(*pte));
+          swapfree(blockno);
+
+          *pte = (*pte | PTE_V) & ~PTE_S;
+          VMSTAT_ADD(nswapin, 1);
+          VMSTAT_ADD(nswapped, -1);
+          p->nswapin++;
+        }
+        else if (!(*pte & PTE_V)) {
+          char *pa = kalloc_zeroed();
+          if (pa == 0)
+            return -1;
+          *pte = PA2PTE(pa) | PTE_W | PTE_X | PTE_R | PTE_U | PTE_V;
+        }
       }
     }
     return 0;
   } else if (advice == MADV_DONTNEED) {
-    begin_op();
-
-    pte_t *pte;
-    for (uint64 va = begin; va <= last; va += PGSIZE) {
-      pte = walk(pgtbl, va, 0);
-      // printf("dontneed: %p\n",pte);
-      if (pte != 0 && (*pte & PTE_V) && !(*pte & PTE_P)) {
-        char *pa = (char*) swap_page_from_pte(pte);
-        if (pa == 0) {
-          end_op();
-          return -1;
-        }
-        kfree(pa);
-
-        // NTU OS 2024
-        // Swapped out page should not appear in
-        // page replacement buffer
-        uint64 shifted_va = (va << 43) >> 55;
-        if (!(shifted_va == 0 || shifted_va == 1 || shifted_va == 2)) {
-          #ifdef PG_REPLACEMENT_USE_LRU
-          // TODO
-          int idx = lru_find(&lru, pte);
-          lru_pop(&lru, idx);
-          #elif defined(PG_REPLACEMENT_USE_FIFO)
-          // TODO
-          int idx = q_find(&q, pte);
-          q_pop_idx(&q, idx);
-          #endif
+    // a page is unmapped, and the TLBs flushed, before it
+    // is written out, so no hart can store to it meanwhile.
+    struct tlbbatch tb;
+    struct swapout out[NSWAPOUT];
+    int nout = 0;
+    tlbbatch_init(&tb, pgtbl);
+
+    for (va = begin; va < end; va += n * PGSIZE) {
+      if ((pte = walkrange(pgtbl, va, end, 0, &n)) == 0)
+        continue;
+      for (uint64 i = 0; i < n; i++, pte++) {
+        uint64 va0 = va + i * PGSIZE;
+        pgbuf_access(va0, pte);
+        if ((*pte & PTE_V) && !(*pte & PTE_P)) {
+          out[nout].pa = swap_page_from_pte(pte);
+          out[nout].dp = PTE2BLOCKNO(*pte);
+          nout++;
+          p->nswapout++;
+          tlbbatch_add(&tb, va0);
+
+          // NTU OS 2024
+          // Swapped out page should not appear in
+          // page replacement buffer
+          uint64 shifted_va = (va0 << 43) >> 55;
+          if (!(shifted_va == 0 || shifted_va == 1 || shifted_va == 2)) {
+            #ifdef PG_REPLACEMENT_USE_LRU
+            // TODO
+            int idx = lru_find(&lru, pte);
+            lru_pop(&lru, idx);
+            #elif defined(PG_REPLACEMENT_USE_FIFO)
+            // TODO
+            int idx = q_find(&q, pte);
+            q_pop_idx(&q, idx);
+            #endif
+          }
+
+          if (nout == NSWAPOUT) {
+            swapout_flush(&tb, out, nout);
+            nout = 0;
+          }
         }
       }
     }
 
-    end_op();
+    swapout_flush(&tb, out, nout);
     return 0;
 
 
   } else if(advice == MADV_PIN) {
-    begin_op();
-    
-    pte_t *pte;
-    for (uint64 va = begin; va <= last; va += PGSIZE) {
-      pte = walk(pgtbl, va, 0);
-      if (pte == 0) {
+    // PTE_P is a software bit that the MMU ignores,
+    // so pinning and unpinning need no TLB flush.
+    for (va = begin; va < end; va += n * PGSIZE) {
+      if ((pte = walkrange(pgtbl, va, end, 0, &n)) == 0) {
         panic("madvise PIN: walk failed");
         return -1;
       }
-      *pte |= PTE_P;
+      for (uint64 i = 0; i < n; i++, pte++) {
+        pgbuf_access(va + i * PGSIZE, pte);
+        if (!(*pte & PTE_P))
+          VMSTAT_ADD(npinned, 1);
+        *pte |= PTE_P;
+      }
     }
 
-    end_op();
     return 0;
   } else if(advice == MADV_UNPIN) {
-    begin_op();
-    
-    pte_t *pte;
-    for (uint64 va = begin; va <= last; va += PGSIZE) {
-      pte = walk(pgtbl, va, 0);
-      if (pte == 0) {
+    for (va = begin; va < end; va += n * PGSIZE) {
+      if ((pte = walkrange(pgtbl, va, end, 0, &n)) == 0) {
         panic("madvise UNPIN: walk failed");
         return -1;
       }
-      *pte &= ~PTE_P;
+      for (uint64 i = 0; i < n; i++, pte++) {
+        pgbuf_access(va + i * PGSIZE, pte);
+        if (*pte & PTE_P)
+          VMSTAT_ADD(npinned, -1);
+        *pte &= ~PTE_P;
+      }
     }
 
-    end_op();
     return 0;
   }
   else {
@@ -664,7 +880,7 @@ void vmprint(pagetable_t pagetable) {
     if (*pte2 & PTE_V || *pte2 & PTE_S) {
       uint64 pa2 = PTE2PA(*pte2);
       uint64_t va2 = i2 << PXSHIFT(2);
-      uint64 blockno2 = PTE2BLOCKNO(*pte2);
+      uint64 blockno2 = swapblockno(PTE2BLOCKNO(*pte2));
       if (*pte2 & PTE_S) {
         printf("+-- %d: pte=%p va=%p blockno=%p", i2, pte2, va2, blockno2);
       }
@@ -702,7 +918,7 @@ void vmprint(pagetable_t pagetable) {
 
             uint64 pa1 = PTE2PA(*pte1);
             uint64_t va1 = va2 + (i1 << 21);
-            uint64 blockno1 = PTE2BLOCKNO(*pte1);
+            uint64 blockno1 = swapblockno(PTE2BLOCKNO(*pte1));
             if (*pte1 & PTE_S) {
               printf("+-- %d: pte=%p va=%p blockno=%p", i1, pte1, va1, blockno1);
             }
@@ -741,7 +957,7 @@ void vmprint(pagetable_t pagetable) {
 
                   uint64 pa0 = PTE2PA(*pte0);
                   uint64 va0 = va1 + (i0 << 12);
-                  uint64 blockno0 = PTE2BLOCKNO(*pte0);
+                  uint64 blockno0 = swapblockno(PTE2BLOCKNO(*pte0));
                   // printf("i = %d\n", i0);
                   if (*pte0 & PTE_S) {
                     printf("+-- %d: pte=%p va=%p blockno=%p", i0, pte0, va0, blockno0);
@@ -767,4 +983,139 @@ void vmprint(pagetable_t pagetable) {
       }
     }
   }
-}
\ No newline at end of file
+}
+struct snapbuf {
+  pagetable_t pagetable;  // of the user buffer
+  uint64 ubuf;
+  int max;
+  int total;              // records copied out
+  int nrec;               // records in rec[]
+  struct pgsnap rec[32];
+};
+
+// Add a record for pte to sb, copying a full rec[] out.
+static int
+snapadd(struct snapbuf *sb, pte_t pte, int level, int index, uint64 va)
+{
+  struct pgsnap *r = &sb->rec[sb->nrec];
+
+  r->va = va;
+  r->addr = (pte & PTE_S) ? swapblockno(PTE2BLOCKNO(pte)) : PTE2PA(pte);
+  r->flags = PTE_FLAGS(pte);
+  r->level = level;
+  r->area = (pte & PTE_S) ? swapareano(PTE2BLOCKNO(pte)) : 0;
+  r->index = index;
+  if(++sb->nrec < NELEM(sb->rec))
+    return 0;
+  // the copy may fault in the buffer's page, but only
+  // adds PTEs, so the walk's page-table pages stay valid.
+  if(copyout(sb->pagetable, sb->ubuf + sb->total*sizeof(sb->rec[0]),
+             (char*)sb->rec, sizeof(sb->rec)) < 0)
+    return -1;
+  sb->total += sb->nrec;
+  sb->nrec = 0;
+  return 0;
+}
+
+// Add records for the PTEs of page-table page pt, at level,
+// which maps from base, that overlap [va, end).
+static int
+snapwalk(struct snapbuf *sb, pagetable_t pt, int level, uint64 base, uint64 va, uint64 end)
+{
+  uint64 lo, sz = 1L << PXSHIFT(level);
+  pte_t pte;
+
+  for(int i = 0; i < 512 && sb->total + sb->nrec < sb->max; i++){
+    lo = base + i*sz;
+    if(lo + sz <= va)
+      continue;
+    if(lo >= end)
+      break;
+    pte = pt[i];
+    if((pte & (PTE_V|PTE_S)) == 0)
+      continue;
+    if(snapadd(sb, pte, level, i, lo) < 0)
+      return -1;
+    if(level > 0 && (pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0 &&
+       snapwalk(sb, (pagetable_t)PTE2PA(pte), level-1, lo, va, end) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Copy a struct pgsnap for each mapped or swapped PTE, at every
+// level, that maps part of [va, va+len) of pagetable to the user
+// buffer at ubuf, at most max of them. This is what vmprint()
+// shows, without going through the console.
+// Returns the number of records copied, or -1.
+int
+pgsnap(pagetable_t pagetable, uint64 va, uint64 len, uint64 ubuf, int max)
+{
+  struct snapbuf sb;
+  uint64 end;
+
+  if(va >= MAXVA)
+    return 0;
+  end = va + len > MAXVA || va + len < va ? MAXVA : PGROUNDUP(va + len);
+  sb.pagetable = pagetable;
+  sb.ubuf = ubuf;
+  sb.max = max;
+  sb.total = 0;
+  sb.nrec = 0;
+  // a snapshot is not a use, so no pgbuf_access() here.
+  if(snapwalk(&sb, pagetable, 2, 0, PGROUNDDOWN(va), end) < 0)
+    return -1;
+  if(sb.nrec > 0 &&
+     copyout(pagetable, ubuf + sb.total*sizeof(sb.rec[0]), (char*)sb.rec,
+             sb.nrec*sizeof(sb.rec[0])) < 0)
+    return -1;
+  return sb.total + sb.nrec;
+}
+
+// Count the resident, swapped-out and pinned pages
+// of a user address space of size sz.
+void
+uvmfootprint(pagetable_t pagetable, uint64 sz, uint64 *nres, uint64 *nswap, uint64 *npin)
+{
+  uint64 a, end, n;
+  pte_t *pte;
+
+  *nres = *nswap = *npin = 0;
+  end = PGROUNDUP(sz);
+  for(a = 0; a < end; a += n*PGSIZE){
+    if((pte = walkrange(pagetable, a, end, 0, &n)) == 0)
+      continue;
+    for(uint64 i = 0; i < n; i++, pte++){
+      if(*pte & PTE_V)
+        (*nres)++;
+      else if(*pte & PTE_S)
+        (*nswap)++;
+      if(*pte & PTE_P)
+        (*npin)++;
+    }
+  }
+}
+
+// Fill in *st with the event counters and the
+// current memory, swap and replacement-buffer state.
+void
+vmstatread(struct vmstat *st)
+{
+  uint64 nfree, ntotal;
+
+  *st = vmstats;
+  kmemcount(&nfree, &ntotal);
+  st->nfree = nfree;
+  st->nused = ntotal - nfree;
+  st->nswapfree = swapcount();
+#ifdef PG_REPLACEMENT_USE_LRU
+  st->npgbuf = lru.size;
+  st->pgbufsize = PG_BUF_SIZE;
+#elif defined(PG_REPLACEMENT_USE_FIFO)
+  st->npgbuf = q.size;
+  st->pgbufsize = PG_BUF_SIZE;
+#else
+  st->npgbuf = 0;
+  st->pgbufsize = 0;
+#endif
+}
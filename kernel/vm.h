@@ -3,3 +3,16 @@
 #define MADV_DONTNEED 2
 #define MADV_PIN 3
 #define MADV_UNPIN 4
+
+// One record of a pgsnap() page-table snapshot: a PTE that is
+// mapped (PTE_V) or swapped out (PTE_S). Records come in the
+// order vmprint() prints them, each page-table page's PTE
+// followed by the PTEs in that page.
+struct pgsnap {
+  uint64 va;     // first virtual address the PTE maps
+  uint64 addr;   // physical address, or swap blockno if PTE_S
+  ushort flags;  // PTE flag bits, PTE_V .. PTE_S in riscv.h
+  uchar level;   // 2 or 1 for a page-table page, 0 for a page
+  uchar area;    // swap area, if PTE_S
+  uint index;    // the PTE's index in its page-table page
+};
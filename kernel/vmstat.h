@@ -0,0 +1,28 @@
+// Virtual-memory statistics, as returned by the vmstat() system call.
+// Page counts are in 4096-byte pages; a swap slot holds one page.
+struct vmstat {
+  uint64 nfree;      // free physical pages
+  uint64 nused;      // allocated physical pages
+  uint64 npinned;    // user PTEs pinned with MADV_PIN
+  uint64 nswapped;   // user pages swapped out
+  uint64 nswapslot;  // swap slots in use
+  uint64 nswapfree;  // swap slots free
+  uint64 nminflt;    // page faults served without disk I/O
+  uint64 nmajflt;    // page faults that read from swap
+  uint64 nswapin;    // pages read from swap, including MADV_WILLNEED
+  uint64 nswapout;   // pages written to swap
+  uint64 npgbuf;     // pages in the replacement buffer
+  uint64 pgbufsize;  // replacement buffer capacity; 0 if none
+};
+
+// Per-process paging statistics, as returned by getrusage().
+struct rusage {
+  uint64 nminflt;    // page faults served without disk I/O
+  uint64 nmajflt;    // page faults that read from swap
+  uint64 nswapin;    // pages read from swap, including MADV_WILLNEED
+  uint64 nswapout;   // pages written to swap
+  // only for the calling process; 0 for others.
+  uint64 nresident;  // user pages in memory now
+  uint64 nswapped;   // user pages swapped out now
+  uint64 npinned;    // user PTEs pinned with MADV_PIN now
+};
@@ -19,11 +19,13 @@
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ swap space ]
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog;     // Number of log blocks, including the header
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
+int swapstart = (FSSIZE + SWAPBLKS-1) / SWAPBLKS * SWAPBLKS; // slot-aligned
 int nblocks;  // Number of data blocks
 
 int fsfd;
@@ -89,6 +91,14 @@ main(int argc, char *argv[])
   if(fsfd < 0)
     die(argv[1]);
 
+  // the log takes 1/LOGFRAC of the disk, enough for at least
+  // three transactions, and no more than its header can describe.
+  nlog = FSSIZE / LOGFRAC;
+  if(nlog < MAXOPBLOCKS*3 + 1)
+    nlog = MAXOPBLOCKS*3 + 1;
+  if(nlog > LOGSIZE + 1)
+    nlog = LOGSIZE + 1;
+
   // 1 fs block = 1 disk sector
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
   nblocks = FSSIZE - nmeta;
@@ -101,13 +111,16 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(swapstart);
+  sb.nswap = xint(NSWAP);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("swap blocks %d at %d\n", NSWAP, swapstart);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < swapstart + NSWAP; i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
@@ -128,10 +141,12 @@ main(int argc, char *argv[])
   iappend(rootino, &de, sizeof(de));
 
   for(i = 2; i < argc; i++){
-    // get rid of "user/"
+    // get rid of "user/" or "kernel/"
     char *shortname;
     if(strncmp(argv[i], "user/", 5) == 0)
       shortname = argv[i] + 5;
+    else if(strncmp(argv[i], "kernel/", 7) == 0)
+      shortname = argv[i] + 7;
     else
       shortname = argv[i];
     
@@ -1,11 +1,25 @@
 import os
+import re
 from gradelib import *
 
 gen = 0
 
-name = ['mp2_1', 'mp2_2', 'mp2_3', 'mp2_4', 'mp2_5', 'custom_1', 'custom_2', 'custom_3', 'custom_4', 'custom_5']
-bases = ['qemu', 'qemu', 'qemu', 'fifo', 'lru', 'qemu', 'qemu', 'qemu', 'fifo', 'lru']
-scores = [6, 12, 12, 12, 18, 4, 8, 8, 8, 12]
+name = ['mp2_1', 'mp2_2', 'mp2_3', 'mp2_4', 'mp2_5', 'custom_1', 'custom_2', 'custom_3', 'custom_4', 'custom_5', 'custom_6', 'custom_7', 'custom_8', 'custom_9', 'custom_10']
+bases = ['qemu', 'qemu', 'qemu', 'fifo', 'lru', 'qemu', 'qemu', 'qemu', 'fifo', 'lru', 'qemu', 'qemu', 'qemu', 'qemu', 'qemu']
+# Physical addresses and swap block numbers depend on the kernel's
+# size and on how its allocators hand out pages and slots, not on
+# the paging being graded, so lines are compared with them masked.
+# A PTE's address keeps its offset in the page-table page, which
+# says which entry it is. Which pages are mapped, swapped or
+# pinned, at which va, and in what order in the replacement
+# buffer, still counts.
+addr = re.compile(r'(page table |pa=|blockno=)0x[0-9a-f]+')
+pte = re.compile(r'(pte=|pte: )0x[0-9a-f]+([0-9a-f]{3})')
+
+def mask(lines):
+    return [pte.sub(r'\1<page>+\2', addr.sub(r'\1<addr>', line)) for line in lines]
+
+scores = [6, 12, 12, 12, 18, 4, 8, 8, 8, 12, 4, 4, 4, 4, 4]
 
 for s, base, score in zip(name, bases, scores):
 
@@ -26,5 +40,6 @@ for s, base, score in zip(name, bases, scores):
             f = open("mp2_output/{}.out".format(t), 'w+')
             f.write("\n".join(res[st+1:ed]))
         else: 
-            r.match(*(open("mp2_output/{}.out".format(t), "r").read().splitlines()))
+            expected = open("mp2_output/{}.out".format(t), "r").read().splitlines()
+            assert_lines_match("\n".join(mask(r.qemu.output.splitlines())), *mask(expected))
 run_tests()
@@ -0,0 +1,83 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+#include "kernel/vm.h"
+#include "kernel/vmstat.h"
+
+#define PG_SIZE 4096
+#define NR_PG 16
+#define NSNAP 256
+
+/*pgsnap(), vmstat() and getrusage() describe swapped-out pages*/
+
+static struct pgsnap snap[NSNAP];
+
+int main(int argc, char *argv[]) {
+  char *raw = malloc((NR_PG + 1) * PG_SIZE);
+  char *ptr = (char *)(((uint64)raw + PG_SIZE - 1) & ~(uint64)(PG_SIZE - 1));
+  struct vmstat st0, st1;
+  struct rusage ru0, ru1;
+  uint64 lo[3], hi[3];
+  int n, ok, seen;
+
+  for (int i = 0; i < NR_PG; i++)
+    ptr[i*PG_SIZE] = i;
+  vmstat(&st0);
+  getrusage(0, &ru0);
+  madvise(ptr + 4*PG_SIZE, 4*PG_SIZE, MADV_DONTNEED);
+  vmstat(&st1);
+  getrusage(0, &ru1);
+
+  /* every level is there, each record inside the one above */
+  /* it, and pages 4..7 of ptr, and only those, are swapped */
+  n = pgsnap(0, (uint64)sbrk(0), snap, NSNAP);
+  ok = n > 0 && n < NSNAP;
+  seen = 0;
+  lo[2] = 0;
+  hi[2] = MAXVA;
+  for (int i = 0; ok && i < n; i++) {
+    struct pgsnap *r = &snap[i];
+    int l = r->level;
+    if (l > 2 || r->va < lo[l] || r->va >= hi[l] ||
+        r->va != lo[l] + ((uint64)r->index << PXSHIFT(l))) {
+      ok = 0;
+      break;
+    }
+    if (l > 0) {
+      ok = (r->flags & (PTE_V | PTE_S)) == PTE_V;
+      lo[l-1] = r->va;
+      hi[l-1] = r->va + (1L << PXSHIFT(l));
+      continue;
+    }
+    int swapped = r->va >= (uint64)ptr + 4*PG_SIZE && r->va < (uint64)ptr + 8*PG_SIZE;
+    if (swapped)
+      ok = (r->flags & (PTE_V | PTE_S)) == PTE_S;
+    else
+      ok = (r->flags & (PTE_V | PTE_S)) == PTE_V && r->addr % PG_SIZE == 0;
+    if (r->va >= (uint64)ptr && r->va < (uint64)ptr + NR_PG*PG_SIZE)
+      seen++;
+  }
+  ok = ok && seen == NR_PG;
+  printf("pgsnap: %s\n", ok ? "ok" : "bad");
+
+  ok = st1.nswapped - st0.nswapped == 4 && st1.nswapout - st0.nswapout == 4 &&
+       st1.nswapslot - st0.nswapslot == 4 && st0.nswapfree - st1.nswapfree == 4;
+  printf("vmstat: %s\n", ok ? "ok" : "bad");
+
+  ok = ru1.nswapout - ru0.nswapout == 4 && ru1.nswapped == 4 &&
+       ru0.nresident - ru1.nresident == 4;
+  printf("getrusage: %s\n", ok ? "ok" : "bad");
+
+  /* and back: one by madvise, the rest by faults */
+  madvise(ptr + 4*PG_SIZE, PG_SIZE, MADV_WILLNEED);
+  ok = 1;
+  for (int i = 0; i < NR_PG; i++)
+    if (ptr[i*PG_SIZE] != i)
+      ok = 0;
+  getrusage(0, &ru0);
+  ok = ok && ru0.nswapped == 0 && ru0.nmajflt - ru1.nmajflt == 3 &&
+       ru0.nswapin - ru1.nswapin == 4;
+  printf("swapin: %s\n", ok ? "ok" : "bad");
+  exit(0);
+}
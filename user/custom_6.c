@@ -0,0 +1,34 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/vm.h"
+
+#define PG_SIZE 4096
+#define NR_PG 16
+
+/*pages swapped out and back in keep their contents*/
+
+static int check(char *ptr, int lo, int hi) {
+  for (int i = lo; i < hi; i++)
+    for (int j = 0; j < PG_SIZE; j += 512)
+      if (ptr[i*PG_SIZE + j] != (char)(i + j/512))
+        return -1;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  char *ptr = malloc(NR_PG * PG_SIZE);
+  for (int i = 0; i < NR_PG; i++)
+    for (int j = 0; j < PG_SIZE; j += 512)
+      ptr[i*PG_SIZE + j] = i + j/512;
+
+  /* swapped back in on a page fault */
+  madvise((uint64) ptr + 4*PG_SIZE, 4*PG_SIZE, MADV_DONTNEED);
+  printf("fault: %s\n", check(ptr, 0, NR_PG) == 0 ? "ok" : "bad");
+
+  /* swapped back in by madvise */
+  madvise((uint64) ptr + 8*PG_SIZE, 4*PG_SIZE, MADV_DONTNEED);
+  madvise((uint64) ptr + 8*PG_SIZE, 4*PG_SIZE, MADV_WILLNEED);
+  printf("willneed: %s\n", check(ptr, 0, NR_PG) == 0 ? "ok" : "bad");
+  exit(0);
+}
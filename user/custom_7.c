@@ -0,0 +1,60 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/vm.h"
+#include "kernel/vmstat.h"
+
+#define PG_SIZE 4096
+#define NR_PG 32
+
+/*repeated MADV_DONTNEED / MADV_WILLNEED round trips keep page contents*/
+
+static void fill(char *ptr, int gen) {
+  for (int i = 0; i < NR_PG; i++)
+    for (int j = 0; j < PG_SIZE; j += 256)
+      ptr[i*PG_SIZE + j] = i*7 + j/256 + gen;
+}
+
+static int check(char *ptr, int gen) {
+  for (int i = 0; i < NR_PG; i++)
+    for (int j = 0; j < PG_SIZE; j += 256)
+      if (ptr[i*PG_SIZE + j] != (char)(i*7 + j/256 + gen))
+        return -1;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  /* page-aligned, so page counts are exact */
+  char *raw = malloc((NR_PG + 1) * PG_SIZE);
+  char *ptr = (char *)(((uint64)raw + PG_SIZE - 1) & ~(uint64)(PG_SIZE - 1));
+  struct rusage ru;
+  int ok;
+
+  for (int gen = 0; gen < 3; gen++) {
+    fill(ptr, gen);
+    madvise(ptr, NR_PG * PG_SIZE, MADV_DONTNEED);
+    getrusage(0, &ru);
+    ok = ru.nswapped == NR_PG;
+    /* half come back by madvise, the rest on a fault */
+    madvise(ptr, NR_PG/2 * PG_SIZE, MADV_WILLNEED);
+    ok = ok && check(ptr, gen) == 0;
+    printf("round %d: %s\n", gen, ok ? "ok" : "bad");
+  }
+
+  /* an unaligned range covers every page it touches */
+  fill(ptr, 3);
+  madvise(ptr + 100, PG_SIZE, MADV_DONTNEED);
+  getrusage(0, &ru);
+  ok = ru.nswapped == 2;
+  ok = ok && check(ptr, 3) == 0;
+  printf("unaligned: %s\n", ok ? "ok" : "bad");
+
+  /* a pinned page stays in memory */
+  madvise(ptr, PG_SIZE, MADV_PIN);
+  madvise(ptr, NR_PG * PG_SIZE, MADV_DONTNEED);
+  getrusage(0, &ru);
+  ok = ru.nswapped == NR_PG - 1 && ru.npinned == 1;
+  ok = ok && check(ptr, 3) == 0;
+  printf("pinned: %s\n", ok ? "ok" : "bad");
+  exit(0);
+}
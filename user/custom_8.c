@@ -0,0 +1,49 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+#include "kernel/vm.h"
+
+#define PG_SIZE 4096
+#define MB2 0x200000
+
+/*system calls copy to and from swapped-out pages across page and 2MB boundaries*/
+
+int main(int argc, char *argv[]) {
+  char *top = sbrk(0);
+  int len = 3 * PG_SIZE;
+  int fd, ok;
+
+  if ((uint64)top > MB2 - 4*PG_SIZE || sbrk(MB2 + 8*PG_SIZE - (uint64)top) == (char *)-1) {
+    printf("sbrk failed\n");
+    exit(1);
+  }
+
+  /* both straddle page boundaries; src also the 2MB one */
+  char *src = (char *)MB2 - 3000;
+  char *dst = (char *)MB2 + 4*PG_SIZE + 100;
+  for (int i = 0; i < len; i++) {
+    src[i] = i*13 + 7;
+    dst[i] = 0;
+  }
+  madvise(src, len, MADV_DONTNEED);
+  madvise(dst, len, MADV_DONTNEED);
+
+  /* copyin() from swapped pages, copyout() to them */
+  ok = (fd = open("copytest", O_CREATE | O_RDWR)) >= 0 && write(fd, src, len) == len;
+  close(fd);
+  ok = ok && (fd = open("copytest", O_RDONLY)) >= 0 && read(fd, dst, len) == len;
+  close(fd);
+  for (int i = 0; ok && i < len; i++)
+    if (dst[i] != (char)(i*13 + 7))
+      ok = 0;
+  printf("copyin/copyout: %s\n", ok ? "ok" : "bad");
+
+  /* copyinstr() of a path that crosses the 2MB boundary */
+  char *name = (char *)MB2 - 4;
+  strcpy(name, "copytest");
+  madvise((char *)MB2 - PG_SIZE, 2*PG_SIZE, MADV_DONTNEED);
+  ok = unlink(name) == 0 && open("copytest", O_RDONLY) < 0;
+  printf("copyinstr: %s\n", ok ? "ok" : "bad");
+  exit(0);
+}
@@ -0,0 +1,89 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+#include "kernel/vm.h"
+#include "kernel/vmstat.h"
+
+#define PG_SIZE 4096
+#define NR_PG 64
+
+/*swap slots are striped across areas, reused, and freed on exit*/
+
+static struct pgsnap snap[NR_PG + 16];
+
+static void fill(char *ptr, int gen) {
+  for (int i = 0; i < NR_PG; i++)
+    ptr[i*PG_SIZE] = i + gen;
+}
+
+static int check(char *ptr, int gen) {
+  for (int i = 0; i < NR_PG; i++)
+    if (ptr[i*PG_SIZE] != (char)(i + gen))
+      return -1;
+  return 0;
+}
+
+static uint64 slots(void) {
+  struct vmstat st;
+  vmstat(&st);
+  return st.nswapslot;
+}
+
+int main(int argc, char *argv[]) {
+  char *raw = malloc((NR_PG + 1) * PG_SIZE);
+  char *ptr = (char *)(((uint64)raw + PG_SIZE - 1) & ~(uint64)(PG_SIZE - 1));
+  uint64 base = slots();
+  int n, nswap, ok, pid;
+  uint64 areas = 0;
+
+  /* evictions in va order; with several areas in use, */
+  /* consecutive ones must go to different areas */
+  fill(ptr, 0);
+  madvise(ptr, NR_PG * PG_SIZE, MADV_DONTNEED);
+  ok = slots() == base + NR_PG;
+  n = pgsnap(ptr, NR_PG * PG_SIZE, snap, NR_PG + 16);
+  nswap = 0;
+  for (int i = 0; i < n; i++) {
+    if (snap[i].level != 0)
+      continue;
+    if (!(snap[i].flags & PTE_S))
+      ok = 0;
+    areas |= 1L << snap[i].area;
+    nswap++;
+  }
+  ok = ok && nswap == NR_PG;
+  if (areas & (areas - 1)) {
+    int last = -1;
+    for (int i = 0; i < n; i++) {
+      if (snap[i].level != 0)
+        continue;
+      if (snap[i].area == last)
+        ok = 0;
+      last = snap[i].area;
+    }
+  }
+  ok = ok && check(ptr, 0) == 0 && slots() == base;
+  printf("striping: %s\n", ok ? "ok" : "bad");
+
+  /* swapping in frees each slot for reuse */
+  ok = 1;
+  for (int gen = 1; gen <= 8; gen++) {
+    fill(ptr, gen);
+    madvise(ptr, NR_PG * PG_SIZE, MADV_DONTNEED);
+    madvise(ptr, NR_PG * PG_SIZE, MADV_WILLNEED);
+    ok = ok && check(ptr, gen) == 0 && slots() == base;
+  }
+  printf("reuse: %s\n", ok ? "ok" : "bad");
+
+  /* exit frees the slots of pages still swapped out */
+  if ((pid = fork()) == 0) {
+    fill(ptr, 9);
+    madvise(ptr, NR_PG * PG_SIZE, MADV_DONTNEED);
+    exit(slots() == base + NR_PG ? 0 : 1);
+  }
+  wait(&ok);
+  ok = pid > 0 && ok == 0 && slots() == base;
+  printf("exit: %s\n", ok ? "ok" : "bad");
+  exit(0);
+}
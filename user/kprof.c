@@ -0,0 +1,210 @@
+// kprof [-u prog.sym] command args...
+// Run command with the sampling profiler on (kernel built with
+// make PROFILE=1) and print the functions the samples fell in.
+// Kernel pcs are symbolized with /kernel.sym, which PROFILE=1
+// puts in fs.img; user pcs with the -u symbol file, if given.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define MAXSAMPLE 8192
+#define NTOP 20
+
+struct sym {
+  uint64 addr;
+  char *name;
+  int count;
+};
+
+struct symtab {
+  struct sym *sym;
+  int n;
+};
+
+static struct profsample samples[MAXSAMPLE];
+
+static uint64
+hex(char **sp)
+{
+  uint64 v = 0;
+  char *s = *sp;
+
+  for(;; s++){
+    if(*s >= '0' && *s <= '9')
+      v = v*16 + *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      v = v*16 + *s - 'a' + 10;
+    else
+      break;
+  }
+  *sp = s;
+  return v;
+}
+
+// Load an objdump-derived "address name" symbol file,
+// sorted by address. Returns 0 if it can't be read.
+static int
+loadsyms(char *path, struct symtab *t)
+{
+  struct stat st;
+  char *buf, *s, *name;
+  int fd, n, i, j;
+  struct sym tmp;
+
+  t->n = 0;
+  if((fd = open(path, O_RDONLY)) < 0)
+    return 0;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0){
+    close(fd);
+    return 0;
+  }
+  for(n = 0; n < st.size; ){
+    i = read(fd, buf + n, st.size - n);
+    if(i <= 0)
+      break;
+    n += i;
+  }
+  close(fd);
+  buf[n] = 0;
+
+  j = 1;
+  for(s = buf; *s; s++)
+    if(*s == '\n')
+      j++;
+  t->sym = malloc(j * sizeof(struct sym));
+
+  for(s = buf; *s; ){
+    uint64 addr = hex(&s);
+    if(*s == ' '){
+      name = ++s;
+      while(*s && *s != '\n')
+        s++;
+      if(*s)
+        *s++ = 0;
+      t->sym[t->n].addr = addr;
+      t->sym[t->n].name = name;
+      t->sym[t->n].count = 0;
+      t->n++;
+    } else {
+      while(*s && *s != '\n')
+        s++;
+      if(*s)
+        s++;
+    }
+  }
+
+  // insertion sort; symbol files are a few thousand lines.
+  for(i = 1; i < t->n; i++){
+    tmp = t->sym[i];
+    for(j = i; j > 0 && t->sym[j-1].addr > tmp.addr; j--)
+      t->sym[j] = t->sym[j-1];
+    t->sym[j] = tmp;
+  }
+  return 1;
+}
+
+// The symbol containing pc: the last one at or below it.
+static struct sym*
+lookup(struct symtab *t, uint64 pc)
+{
+  int lo = 0, hi = t->n;
+
+  while(lo < hi){
+    int mid = (lo + hi) / 2;
+    if(t->sym[mid].addr <= pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo > 0 ? &t->sym[lo-1] : 0;
+}
+
+static void
+top(char *what, struct symtab *t, int total)
+{
+  int i, best;
+
+  for(int k = 0; k < NTOP; k++){
+    best = -1;
+    for(i = 0; i < t->n; i++)
+      if(t->sym[i].count > 0 && (best < 0 || t->sym[i].count > t->sym[best].count))
+        best = i;
+    if(best < 0)
+      return;
+    printf("%d\t%d%%\t%s %s\n", t->sym[best].count,
+           t->sym[best].count * 100 / total, what, t->sym[best].name);
+    t->sym[best].count = 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct symtab ksyms, usyms;
+  struct sym *sym;
+  int n, total, pid, idle = 0, unknown = 0;
+  char *usympath = 0;
+
+  if(argc > 2 && strcmp(argv[1], "-u") == 0){
+    usympath = argv[2];
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: kprof [-u prog.sym] command args...\n");
+    exit(1);
+  }
+
+  if(profile(PROF_START, 0, 0) < 0){
+    fprintf(2, "kprof: kernel not built with PROFILE=1\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "kprof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "kprof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  profile(PROF_STOP, 0, 0);
+
+  for(total = 0; total < MAXSAMPLE; total += n)
+    if((n = profile(PROF_READ, samples + total, MAXSAMPLE - total)) <= 0)
+      break;
+  if(total == 0){
+    printf("kprof: no samples\n");
+    exit(0);
+  }
+
+  if(!loadsyms("/kernel.sym", &ksyms))
+    fprintf(2, "kprof: no /kernel.sym\n");
+  if(usympath && !loadsyms(usympath, &usyms))
+    fprintf(2, "kprof: cannot read %s\n", usympath);
+  if(!usympath)
+    usyms.n = 0;
+
+  for(int i = 0; i < total; i++){
+    struct profsample *s = &samples[i];
+    if(!s->user && s->pid == 0){
+      idle++;
+      continue;
+    }
+    sym = lookup(s->user ? &usyms : &ksyms, s->pc);
+    if(sym)
+      sym->count++;
+    else
+      unknown++;
+  }
+
+  printf("%d samples, %d idle, %d unknown\n", total, idle, unknown);
+  top("kernel", &ksyms, total);
+  top("user", &usyms, total);
+  exit(0);
+}
@@ -0,0 +1,79 @@
+// lockstat [command args...]
+// List the most contended spinlocks. With a command, run it
+// and count only what happened while it ran.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NSLACK 64  // for locks created while the command runs
+#define NTOP 20
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat *before, *after;
+  int nb = 0, na, n, pid, best;
+
+  // as many as there are now, and some.
+  if((n = lockstat(0, 0)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+  n += NSLACK;
+  before = malloc(n * sizeof(struct lockstat));
+  after = malloc(n * sizeof(struct lockstat));
+  if(before == 0 || after == 0){
+    fprintf(2, "lockstat: out of memory\n");
+    exit(1);
+  }
+
+  if(argc > 1){
+    nb = lockstat(before, n);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if((na = lockstat(after, n)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+
+  // subtract the earlier snapshot of the same lock.
+  for(int i = 0; i < na; i++){
+    for(int j = 0; j < nb; j++){
+      if(before[j].id == after[i].id && strcmp(before[j].name, after[i].name) == 0 &&
+         before[j].nacquire <= after[i].nacquire){
+        after[i].nacquire -= before[j].nacquire;
+        after[i].ncontend -= before[j].ncontend;
+        after[i].nspin -= before[j].nspin;
+        break;
+      }
+    }
+  }
+
+  printf("lock\t\tacquire\tcontend\tspin\n");
+  for(int k = 0; k < NTOP; k++){
+    best = -1;
+    for(int i = 0; i < na; i++)
+      if(after[i].ncontend > 0 &&
+         (best < 0 || after[i].ncontend > after[best].ncontend))
+        best = i;
+    if(best < 0)
+      break;
+    printf("%s\t%s%l\t%l\t%l\n", after[best].name,
+           strlen(after[best].name) < 8 ? "\t" : "",
+           after[best].nacquire, after[best].ncontend, after[best].nspin);
+    after[best].ncontend = 0;
+  }
+  exit(0);
+}
@@ -0,0 +1,85 @@
+// pgsnap [npages]
+// Grow memory by npages pages (default 4), swap the last one
+// out, and print this process's page table from a pgsnap()
+// snapshot, as a tree like vmprint()'s.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/vm.h"
+#include "user/user.h"
+
+#define NSNAP 1024
+
+static void
+flags(uint f)
+{
+  if(f & PTE_V) printf(" V");
+  if(f & PTE_R) printf(" R");
+  if(f & PTE_W) printf(" W");
+  if(f & PTE_X) printf(" X");
+  if(f & PTE_U) printf(" U");
+  if(f & PTE_S) printf(" S");
+  if((f & PTE_D) && !(f & PTE_S)) printf(" D");
+  if(f & PTE_P) printf(" P");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pgsnap *snap, *r;
+  uint64 lo[3], hi[3];
+  int npages = 4, n, i, l;
+  char *p;
+
+  if(argc > 2){
+    fprintf(2, "usage: pgsnap [npages]\n");
+    exit(1);
+  }
+  if(argc > 1)
+    npages = atoi(argv[1]);
+  if((snap = malloc(NSNAP * sizeof(*snap))) == 0){
+    fprintf(2, "pgsnap: out of memory\n");
+    exit(1);
+  }
+  if(npages > 0){
+    if((p = sbrk(npages * PGSIZE)) == (char*)-1){
+      fprintf(2, "pgsnap: sbrk failed\n");
+      exit(1);
+    }
+    for(i = 0; i < npages; i++)
+      p[i * PGSIZE] = i;
+    madvise(p + (npages-1) * PGSIZE, PGSIZE, MADV_DONTNEED);
+  }
+
+  if((n = pgsnap(0, (int)(uint64)sbrk(0), snap, NSNAP)) < 0){
+    fprintf(2, "pgsnap: pgsnap failed\n");
+    exit(1);
+  }
+
+  // each record must lie within the page-table page
+  // record before it at the next level up.
+  lo[2] = 0;
+  hi[2] = MAXVA;
+  for(i = 0; i < n; i++){
+    r = &snap[i];
+    l = r->level;
+    if(l > 2 || r->va < lo[l] || r->va >= hi[l] ||
+       r->va != lo[l] + ((uint64)r->index << PXSHIFT(l))){
+      fprintf(2, "pgsnap: bad record %d\n", i);
+      exit(1);
+    }
+    if(l > 0){
+      lo[l-1] = r->va;
+      hi[l-1] = r->va + (1L << PXSHIFT(l));
+    }
+    for(int k = 2; k > l; k--)
+      printf("|   ");
+    printf("+-- %d: va=%p %s=%p", r->index, r->va,
+           (r->flags & PTE_S) ? "blockno" : "pa", r->addr);
+    flags(r->flags);
+    printf("\n");
+  }
+  printf("%d records\n", n);
+  exit(0);
+}
@@ -0,0 +1,98 @@
+// pgtrace [-c] [command args...]
+// Print paging-path latency histograms and drain the kernel trace
+// rings. With a command, drain first, run the command, then report
+// only what it caused. -c prints histogram counts without the
+// individual trace records.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define NEV 64
+
+static char *names[NTREVENT] = {
+[TR_PGFAULT]  "pgfault",
+[TR_SWAPOUT]  "swapout",
+[TR_PGREAD]   "pgread",
+[TR_PGWRITE]  "pgwrite",
+[TR_DISKRW]   "diskrw",
+};
+
+static struct tracehist before, after;
+static struct traceevent ev[NEV];
+
+static int
+drain(int print)
+{
+  int n, total = 0;
+
+  while((n = traceread(0, ev, NEV)) > 0){
+    for(int i = 0; print && i < n; i++)
+      printf("%s cpu %d pid %d va %p blockno %l start %l ticks %l\n",
+             names[ev[i].event], ev[i].cpu, ev[i].pid, ev[i].va,
+             ev[i].blockno, ev[i].start, ev[i].cycles);
+    total += n;
+  }
+  if(n < 0){
+    fprintf(2, "pgtrace: traceread failed\n");
+    exit(1);
+  }
+  return total;
+}
+
+static void
+hist(void)
+{
+  for(int e = 0; e < NTREVENT; e++){
+    uint64 total = 0;
+    for(int i = 0; i < NTRHIST; i++)
+      total += after.hist[e][i] - before.hist[e][i];
+    if(total == 0)
+      continue;
+    printf("%s: %l\n", names[e], total);
+    for(int i = 0; i < NTRHIST; i++){
+      uint64 n = after.hist[e][i] - before.hist[e][i];
+      if(n)
+        printf("  < %l ticks: %l\n", 2UL << i, n);
+    }
+  }
+  if(after.ndropped != before.ndropped)
+    printf("%l trace records dropped\n", after.ndropped - before.ndropped);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int records = 1, pid;
+
+  if(argc > 1 && strcmp(argv[1], "-c") == 0){
+    records = 0;
+    argc--;
+    argv++;
+  }
+
+  if(argc > 1){
+    traceread(&before, 0, 0);
+    drain(0);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "pgtrace: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "pgtrace: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  if(traceread(&after, 0, 0) < 0){
+    fprintf(2, "pgtrace: traceread failed\n");
+    exit(1);
+  }
+  drain(records);
+  hist();
+  exit(0);
+}
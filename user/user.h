@@ -1,6 +1,13 @@
 struct stat;
 struct rtcdate;
 struct sysinfo;
+struct vmstat;
+struct pgsnap;
+struct rusage;
+struct tracehist;
+struct traceevent;
+struct profsample;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -34,6 +41,12 @@ int ugetpid(void);
 #endif
 int vmprint(void);
 int madvise(void *base, int len, int advise);
+int vmstat(struct vmstat*);
+int pgsnap(void *base, int len, struct pgsnap *buf, int n);
+int getrusage(int pid, struct rusage*);
+int traceread(struct tracehist*, struct traceevent*, int n);
+int profile(int cmd, struct profsample*, int n);
+int lockstat(struct lockstat*, int n);
 
 // ulib.c
 int stat(const char*, struct stat*);
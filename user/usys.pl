@@ -41,3 +41,9 @@ entry("pgaccess");
 entry("vmprint");
 entry("madvise");
 entry("pgprint");
+entry("vmstat");
+entry("pgsnap");
+entry("getrusage");
+entry("traceread");
+entry("profile");
+entry("lockstat");
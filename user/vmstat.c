@@ -0,0 +1,76 @@
+// vmstat [interval [count]]
+// Print virtual-memory statistics, then every interval ticks,
+// count times (forever if count is omitted). Fault and swap
+// columns after the first line are changes since the line before.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+static void
+header(void)
+{
+  printf("    free    used  pinned swapped   slots   sfree  minflt  majflt  swapin swapout  pgbuf\n");
+}
+
+// print v right-aligned in an 8-column field;
+// user printf has no field widths.
+static void
+col(uint64 v)
+{
+  int n = 1;
+
+  for(uint64 x = v; x >= 10; x /= 10)
+    n++;
+  while(n++ < 8)
+    printf(" ");
+  printf("%l", v);
+}
+
+static void
+line(struct vmstat *st, struct vmstat *prev)
+{
+  col(st->nfree);
+  col(st->nused);
+  col(st->npinned);
+  col(st->nswapped);
+  col(st->nswapslot);
+  col(st->nswapfree);
+  col(st->nminflt - prev->nminflt);
+  col(st->nmajflt - prev->nmajflt);
+  col(st->nswapin - prev->nswapin);
+  col(st->nswapout - prev->nswapout);
+  printf("    %l/%l\n", st->npgbuf, st->pgbufsize);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat st, prev;
+  int interval = 0, count = -1;
+
+  if(argc > 3){
+    fprintf(2, "usage: vmstat [interval [count]]\n");
+    exit(1);
+  }
+  if(argc > 1)
+    interval = atoi(argv[1]);
+  if(argc > 2)
+    count = atoi(argv[2]);
+
+  memset(&prev, 0, sizeof(prev));
+  header();
+  for(;;){
+    if(vmstat(&st) < 0){
+      fprintf(2, "vmstat: vmstat failed\n");
+      exit(1);
+    }
+    line(&st, &prev);
+    prev = st;
+    if(interval <= 0 || (count > 0 && --count == 0))
+      break;
+    sleep(interval);
+  }
+  exit(0);
+}